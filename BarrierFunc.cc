@@ -0,0 +1,363 @@
+// BarrierFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if HAVE_LINUX_FUTEX_H
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#endif
+
+#include <Str.h>
+
+#include "BESDebug.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "BarrierFunc.h"
+
+namespace debug_function {
+
+#define BARRIER_DEFAULT_TIMEOUT_MS 60000
+
+// A day; also keeps monotonic_ns() + the timeout from wrapping
+#define MAX_BARRIER_TIMEOUT_MS (24LL * 60 * 60 * 1000)
+
+// How long a request that has arrived waits for the lock to leave or to
+// read the release statistics once its own deadline has passed
+#define BARRIER_LOCK_GRACE_NS 1000000000ULL
+
+#define MAX_BARRIER_PARTICIPANTS 100000
+
+#define MAX_BARRIER_NAME 64
+
+// The shared memory segment of barrier 'name' is BARRIER_SHM_PREFIX + name
+#define BARRIER_SHM_PREFIX "/bes_debug_barrier."
+
+#if HAVE_LINUX_FUTEX_H && HAVE_SHM_OPEN
+
+/**
+ * The state of one barrier, in a shared memory segment every beslistener
+ * maps. A new segment is all zeros, which is a barrier nobody has
+ * reached. 'lock' guards the other members and holds the pid of the
+ * process that has it, so a dead holder can be found; the waiters sleep on a
+ * futex on 'generation', which the last to arrive bumps to release
+ * them. The times are CLOCK_MONOTONIC, which all processes share.
+ */
+struct BarrierState {
+    volatile int lock;
+    volatile uint32_t generation;
+    uint32_t arrived;           // in the current generation
+    uint32_t expected;          // set by the first to arrive
+    uint64_t first_arrival_ns;
+    uint64_t arrival_skew_ns;   // of the last generation released
+    uint64_t release_ns;        // when the last generation was released
+};
+
+/**
+ * Take the lock of 'state', spinning until 'until_ns' at the latest. The
+ * lock is held for a few instructions at a time, so a holder that keeps
+ * it is most likely dead; if no process has the holder's pid, take the
+ * lock over.
+ *
+ * @return True if this process has the lock, false if it gave up
+ */
+static bool lock_barrier(BarrierState *state, uint64_t until_ns)
+{
+    int self = getpid();
+    for (unsigned int spins = 1;; ++spins) {
+        int holder = state->lock;
+        if (holder == 0) {
+            if (__sync_bool_compare_and_swap(&state->lock, 0, self)) return true;
+            continue;
+        }
+
+        if (spins % 1024 == 0) {
+            if (kill(holder, 0) != 0 && errno == ESRCH && __sync_bool_compare_and_swap(&state->lock, holder, self)) {
+                BESDEBUG("DebugFunctions", "lock_barrier() - took over the lock from dead process " << holder << std::endl);
+                return true;
+            }
+            if (monotonic_ns() >= until_ns) return false;
+            sched_yield();
+        }
+    }
+}
+
+static void unlock_barrier(BarrierState *state)
+{
+    __sync_lock_release(&state->lock);
+}
+
+/**
+ * Wait until 'word' is no longer 'value', or 'ns' pass. The futex is not
+ * FUTEX_PRIVATE because the waiters are in different processes.
+ */
+static void futex_wait(volatile uint32_t *word, uint32_t value, uint64_t ns)
+{
+    struct timespec timeout;
+    timeout.tv_sec = ns / 1000000000ULL;
+    timeout.tv_nsec = ns % 1000000000ULL;
+    syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, 0, 0);
+}
+
+static void futex_wake_all(volatile uint32_t *word)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, 0, 0, 0);
+}
+
+/**
+ * Map the segment of barrier 'name', making it if need be. On error
+ * write the reason to 'msg' and return 0.
+ */
+static BarrierState *map_barrier(const string &name, std::ostream &msg)
+{
+    string shm_name = BARRIER_SHM_PREFIX + name;
+    int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT, 0600);
+    if (fd < 0) {
+        msg << "Could not open the shared memory segment " << shm_name << ": " << strerror(errno);
+        return 0;
+    }
+
+    // A new segment is empty; extending it fills it with zeros
+    if (ftruncate(fd, sizeof(BarrierState)) != 0) {
+        msg << "Could not size the shared memory segment " << shm_name << ": " << strerror(errno);
+        close(fd);
+        return 0;
+    }
+
+    void *region = mmap(0, sizeof(BarrierState), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (region == MAP_FAILED) {
+        msg << "Could not map the shared memory segment " << shm_name << ": " << strerror(errno);
+        return 0;
+    }
+
+    return static_cast<BarrierState*>(region);
+}
+
+/**
+ * Arrive at 'state' as one of 'n' and wait for the rest, or until
+ * 'deadline'. Write what happened to 'msg'.
+ */
+static void wait_at_barrier(BarrierState *state, const string &name, uint32_t n, const Deadline &deadline,
+    std::ostream &msg)
+{
+    if (!lock_barrier(state, deadline.ns())) {
+        msg << "Timed out waiting for the lock of barrier '" << name << "'; barrier('" << name
+            << "', 0) removes it.";
+        return;
+    }
+
+    uint64_t arrival = monotonic_ns();
+    if (state->arrived == 0) {
+        state->expected = n;
+        state->first_arrival_ns = arrival;
+    }
+    else if (state->expected != n) {
+        uint32_t expected = state->expected;
+        unlock_barrier(state);
+        msg << "Barrier '" << name << "' is waiting for " << expected << " participants, not " << n << ".";
+        return;
+    }
+
+    uint32_t generation = state->generation;
+    uint32_t position = ++state->arrived;
+    double after_first_ms = (arrival - state->first_arrival_ns) / 1.0e6;
+
+    if (position == n) {
+        // The last to arrive releases everyone
+        state->arrival_skew_ns = arrival - state->first_arrival_ns;
+        state->release_ns = monotonic_ns();
+        state->arrived = 0;
+        __sync_add_and_fetch(&state->generation, 1);
+        unlock_barrier(state);
+        futex_wake_all(&state->generation);
+    }
+    else {
+        unlock_barrier(state);
+
+        while (state->generation == generation) {
+            uint64_t now = monotonic_ns();
+            if (now >= deadline.ns()) {
+                // Leave, unless the release came just now
+                if (!lock_barrier(state, now + BARRIER_LOCK_GRACE_NS)) {
+                    msg << "Timed out after " << (now - arrival) / 1.0e6 << " ms at barrier '" << name
+                        << "' and could not take its lock to leave; its count is now off.";
+                    return;
+                }
+                bool released = state->generation != generation;
+                if (!released) --state->arrived;
+                uint32_t arrived = state->arrived;
+                unlock_barrier(state);
+                if (released) break;
+
+                msg << "Timed out after " << (now - arrival) / 1.0e6 << " ms at barrier '" << name << "' with "
+                    << arrived << " of " << n << " participants arrived.";
+                return;
+            }
+            futex_wait(&state->generation, generation, deadline.ns() - now);
+        }
+    }
+
+    uint64_t resumed = monotonic_ns();
+    if (!lock_barrier(state, resumed + BARRIER_LOCK_GRACE_NS)) {
+        msg << "Released from barrier '" << name << "' with " << n << " participants. This one arrived " << position
+            << " of " << n << ", " << after_first_ms << " ms after the first.";
+        return;
+    }
+    double skew_ms = state->arrival_skew_ns / 1.0e6;
+    double latency_ms = (resumed - state->release_ns) / 1.0e6;
+    unlock_barrier(state);
+
+    BESDEBUG("DebugFunctions", "barrier_ssf() - " << name << ": arrived " << position << " of " << n << ", skew " << skew_ms << " ms, release latency " << latency_ms << " ms" << std::endl);
+
+    msg << "Released from barrier '" << name << "' with " << n << " participants. This one arrived "
+        << position << " of " << n << ", " << after_first_ms << " ms after the first. Arrival skew " << skew_ms
+        << " ms, release latency " << latency_ms << " ms.";
+}
+
+#endif
+
+/*****************************************************************************************
+ * 
+ * Barrier Function (Debug Functions)
+ * 
+ * This server side function makes requests wait for each other, so that
+ * a burst of them can run an expensive path at the same instant. Each
+ * request that calls barrier(name, n) blocks, in whichever beslistener
+ * runs it, until n requests have arrived at the barrier called 'name';
+ * then they are all released together and the rest of the constraint
+ * runs. For example, n clients each asking for
+ *
+ *     barrier("herd", 8),sum_until(500)
+ *
+ * start their sum_until() calls within a fraction of a millisecond of
+ * each other, however spread out the requests were. The response gives
+ * the request's place in the order of arrival, the spread of the arrivals
+ * (arrival skew) and the time from the release to this request resuming
+ * (release latency).
+ *
+ * The barrier lives in the shared memory segment
+ * /dev/shm/bes_debug_barrier.<name> and is used over and over: once n
+ * requests have been released the next n may gather. A request gives up
+ * after timeout_ms (default 60000, at most a day) or before the BES
+ * timeout, whichever is sooner. If a listener dies while waiting the
+ * barrier's count is off; barrier(name, 0) removes the segment.
+ *
+ * @note Linux only (it needs futexes).
+ *
+ */
+string barrier_usage = "barrier(<name>, <n> [,<timeout_ms>]) Wait until <n> requests have reached the barrier <name>, then release them together; report the arrival skew and release latency. An <n> of 0 removes the barrier.";
+BarrierFunc::BarrierFunc()
+{
+    setName("barrier");
+    setDescriptionString((string) "This function holds requests until a number of them have arrived, then releases them together.");
+    setUsageString(barrier_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/barrier");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::barrier_ssf);
+    setFunction(dap4_function<debug_function::barrier_ssf>);
+    setVersion("1.0");
+}
+
+void barrier_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("barrier", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 2 || argc > 3) {
+        msg << "Missing barrier name or participant count!  USAGE: " << barrier_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    libdap::Str *name_param = dynamic_cast<libdap::Str*>(argv[0]);
+    string name = name_param ? name_param->value() : "";
+    if (name.empty() || name.size() > MAX_BARRIER_NAME
+        || name.find_first_not_of("abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_-") != string::npos) {
+        msg << "The barrier name must be 1 to " << MAX_BARRIER_NAME
+            << " letters, digits, '_' or '-'.  USAGE: " << barrier_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    long long n, timeout_ms = BARRIER_DEFAULT_TIMEOUT_MS;
+    if (!get_integer_arg(argv[1], n) || n < 0 || n > MAX_BARRIER_PARTICIPANTS) {
+        msg << "The number of participants must be an integer between 0 and " << MAX_BARRIER_PARTICIPANTS
+            << ".  USAGE: " << barrier_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (argc == 3 && (!get_integer_arg(argv[2], timeout_ms) || timeout_ms < 0 || timeout_ms > MAX_BARRIER_TIMEOUT_MS)) {
+        msg << "The timeout must be an integer number of milliseconds between 0 and " << MAX_BARRIER_TIMEOUT_MS
+            << ".  USAGE: " << barrier_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+#if HAVE_LINUX_FUTEX_H && HAVE_SHM_OPEN
+    if (n == 0) {
+        string shm_name = BARRIER_SHM_PREFIX + name;
+        if (shm_unlink(shm_name.c_str()) == 0 || errno == ENOENT)
+            msg << "Removed barrier '" << name << "'.";
+        else
+            msg << "Could not remove barrier '" << name << "': " << strerror(errno);
+        response->set_value(msg.str());
+        return;
+    }
+
+    // Wait until the timeout or the BES deadline, whichever comes first
+    Deadline deadline(monotonic_ns() + timeout_ms * 1000000ULL);
+    Deadline request_deadline = Deadline::current_request();
+    if (request_deadline.is_set() && request_deadline.ns() < deadline.ns()) deadline = request_deadline;
+
+    BarrierState *state = map_barrier(name, msg);
+    if (state) {
+        wait_at_barrier(state, name, n, deadline, msg);
+        munmap(state, sizeof(BarrierState));
+    }
+#else
+    msg << "This server does not support barrier(); it needs Linux futexes and shm_open().";
+#endif
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
@@ -0,0 +1,51 @@
+// BarrierFunc.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef BARRIERFUNC_H_
+#define BARRIERFUNC_H_
+
+#include <BaseType.h>
+#include <DDS.h>
+#include <ServerFunction.h>
+
+namespace debug_function {
+
+/*****************************************************************************************
+ * 
+ * Barrier Function (Debug Functions)
+ * 
+ * This server side function blocks until argv[1] requests (in any of the
+ * beslisteners) have called it with the barrier name at argv[0], then
+ * releases them all at once. (|||||)
+ *
+ */
+void barrier_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class BarrierFunc: public libdap::ServerFunction {
+public:
+    BarrierFunc();
+    virtual ~BarrierFunc(){}
+};
+
+} // namespace debug_function
+#endif /* BARRIERFUNC_H_ */
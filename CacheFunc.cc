@@ -0,0 +1,299 @@
+// CacheFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <vector>
+
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "CacheFunc.h"
+
+namespace debug_function {
+
+// warm_cache() calls readahead() for this much of the file at a time;
+// Linux quietly limits how much one call reads.
+#define READAHEAD_CHUNK (2 * 1024 * 1024)
+
+/**
+ * Open a file under the BES catalog root for reading.
+ *
+ * @param path The file's name, relative to the catalog root
+ * @param size Value-result parameter; the file's size
+ * @param msg Why the file could not be opened
+ * @return The open file, or -1 if it could not be opened
+ */
+static int open_data_file(const string &path, long long &size, std::stringstream &msg)
+{
+    string full_path, error;
+    if (!find_data_file(path, full_path, error)) {
+        msg << "Cannot use " << path << ": " << error;
+        return -1;
+    }
+
+    int fd = open(full_path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        msg << "Could not open " << path << ": " << strerror(errno);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+
+    size = st.st_size;
+    return fd;
+}
+
+/**
+ * Count the pages of the open file 'fd', 'size' bytes long, that are in
+ * the page cache. Mapping the file does not fault any of it in, so the
+ * count is not disturbed by taking it.
+ *
+ * @return The number of resident pages, or -1 if they could not be counted
+ */
+static long long resident_pages(int fd, long long size)
+{
+    if (size == 0) return 0;
+
+    void *map = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return -1;
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    std::vector<unsigned char> pages((size + page_size - 1) / page_size);
+
+    long long resident = -1;
+    if (mincore(map, size, &pages[0]) == 0) {
+        resident = 0;
+        for (std::vector<unsigned char>::iterator i = pages.begin(), e = pages.end(); i != e; ++i)
+            if (*i & 1) ++resident;
+    }
+
+    munmap(map, size);
+    return resident;
+}
+
+/**
+ * The number of pages in a file of 'size' bytes.
+ */
+static long long file_pages(long long size)
+{
+    long page_size = sysconf(_SC_PAGESIZE);
+    return (size + page_size - 1) / page_size;
+}
+
+/*****************************************************************************************
+ * 
+ * DropCache Function (Debug Functions)
+ * 
+ * This server side function evicts a file under the BES catalog root
+ * from the page cache with posix_fadvise(POSIX_FADV_DONTNEED), so the
+ * next read of it comes from storage. Dirty pages cannot be dropped, so
+ * the file is synced first. The number of the file's pages resident
+ * before and after is counted with mincore(); pages mapped by other
+ * processes may stay resident.
+ *
+ */
+string drop_cache_usage = "drop_cache(<path>) Drop the file <path> under the BES data root from the page cache and report how many of its pages were resident before and after.";
+DropCacheFunc::DropCacheFunc()
+{
+    setName("drop_cache");
+    setDescriptionString((string) "This function drops a file from the page cache.");
+    setUsageString(drop_cache_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/drop_cache");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::drop_cache_ssf);
+    setFunction(dap4_function<debug_function::drop_cache_ssf>);
+    setVersion("1.0");
+}
+
+void drop_cache_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("drop_cache", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    libdap::Str *path = argc == 1 ? dynamic_cast<libdap::Str*>(argv[0]) : 0;
+    if (!path) {
+        msg << "Missing path!  USAGE: " << drop_cache_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    long long size;
+    int fd = open_data_file(path->value(), size, msg);
+    if (fd < 0) {
+        response->set_value(msg.str());
+        return;
+    }
+
+#if HAVE_POSIX_FADVISE && defined(POSIX_FADV_DONTNEED)
+    long long before = resident_pages(fd, size);
+
+    double start_time = monotonic_ms();
+    fdatasync(fd);
+    int status = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    double drop_time = monotonic_ms() - start_time;
+
+    long long after = resident_pages(fd, size);
+
+    BESDEBUG("DebugFunctions", "drop_cache_ssf() - " << path->value() << ": " << before << " -> " << after << " pages" << std::endl);
+
+    if (status != 0)
+        msg << "Could not drop " << path->value() << " from the page cache: " << strerror(status) << ". ";
+    else
+        msg << "Dropped " << path->value() << " (" << file_pages(size) << " pages) from the page cache in " << drop_time
+            << " ms: ";
+    msg << before << " pages resident before, " << after << " after.";
+#else
+    msg << "posix_fadvise(POSIX_FADV_DONTNEED) is not supported on this system.";
+#endif
+
+    close(fd);
+
+    response->set_value(msg.str());
+    return;
+}
+
+/*****************************************************************************************
+ * 
+ * WarmCache Function (Debug Functions)
+ * 
+ * This server side function reads a whole file under the BES catalog
+ * root into the page cache, so the next read of it comes from memory.
+ * By default the file is mapped with MAP_POPULATE, which returns once
+ * every page is resident. With "readahead", readahead() is called for
+ * each READAHEAD_CHUNK of the file instead; the kernel may cap one call
+ * and may finish the reads after it returns, so the 'after' count shows
+ * how much had arrived when the function returned. The number of the
+ * file's pages resident before and after is counted with mincore().
+ *
+ */
+string warm_cache_usage = "warm_cache(<path> [,\"populate\"|\"readahead\"]) Read the file <path> under the BES data root into the page cache and report how many of its pages were resident before and after; \"populate\" (the default) waits for the whole file.";
+WarmCacheFunc::WarmCacheFunc()
+{
+    setName("warm_cache");
+    setDescriptionString((string) "This function reads a file into the page cache.");
+    setUsageString(warm_cache_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/warm_cache");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::warm_cache_ssf);
+    setFunction(dap4_function<debug_function::warm_cache_ssf>);
+    setVersion("1.0");
+}
+
+void warm_cache_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("warm_cache", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    libdap::Str *path = (argc == 1 || argc == 2) ? dynamic_cast<libdap::Str*>(argv[0]) : 0;
+    if (!path) {
+        msg << "Missing path!  USAGE: " << warm_cache_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    bool populate = true;
+    if (argc == 2) {
+        libdap::Str *method = dynamic_cast<libdap::Str*>(argv[1]);
+        string method_name = method ? BESUtil::lowercase(method->value()) : "";
+        if (method_name == "readahead")
+            populate = false;
+        else if (method_name != "populate") {
+            msg << "Unknown method.  USAGE: " << warm_cache_usage;
+            response->set_value(msg.str());
+            return;
+        }
+    }
+
+    long long size;
+    int fd = open_data_file(path->value(), size, msg);
+    if (fd < 0) {
+        response->set_value(msg.str());
+        return;
+    }
+
+    long long before = resident_pages(fd, size);
+
+    double start_time = monotonic_ms();
+    string error;
+    if (size == 0) {
+        // Nothing to read
+    }
+    else if (populate) {
+#ifdef MAP_POPULATE
+        void *map = mmap(0, size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (map == MAP_FAILED)
+            error = strerror(errno);
+        else
+            munmap(map, size);
+#else
+        error = "MAP_POPULATE is not supported on this system";
+#endif
+    }
+    else {
+#if HAVE_READAHEAD
+        for (long long offset = 0; offset < size && error.empty(); offset += READAHEAD_CHUNK)
+            if (readahead(fd, offset, READAHEAD_CHUNK) != 0) error = strerror(errno);
+#else
+        error = "readahead() is not supported on this system";
+#endif
+    }
+    double warm_time = monotonic_ms() - start_time;
+
+    long long after = resident_pages(fd, size);
+
+    close(fd);
+
+    BESDEBUG("DebugFunctions", "warm_cache_ssf() - " << path->value() << ": " << before << " -> " << after << " pages" << std::endl);
+
+    if (!error.empty())
+        msg << "Could not read " << path->value() << " into the page cache: " << error << ". ";
+    else
+        msg << "Warmed " << path->value() << " (" << file_pages(size) << " pages) with "
+            << (populate ? "MAP_POPULATE" : "readahead") << " in " << warm_time << " ms: ";
+    msg << before << " pages resident before, " << after << " after.";
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
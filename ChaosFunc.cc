@@ -0,0 +1,188 @@
+// ChaosFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <stdlib.h>     /* abort, strtod */
+
+#include <Int32.h>
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESError.h"
+
+#include "ChaosFunc.h"
+#include "DebugFunctions.h"
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "SleepDistFunc.h"
+
+namespace debug_function {
+
+/*****************************************************************************************
+ * 
+ * Chaos Function (Debug Functions)
+ * 
+ * This server side function picks one outcome per request: throw the
+ * BESError selected by error_type (as error() does), sleep for a time
+ * drawn from a distribution (as sleep_dist() does), call abort() (as
+ * abort() does) or return normally. Used in a soak test it produces a
+ * steady, known rate of failures and slow responses.
+ *
+ * The delay distribution is given as one string, "<dist>:<p1>:<p2>",
+ * using the names and parameters of sleep_dist(). A seed makes a run
+ * repeatable the way it does for sleep_dist().
+ *
+ */
+string chaos_usage = "chaos(<p_error>, <p_delay>, <p_abort> [,<error_type> [,\"<dist>:<p1>:<p2>\" [,<seed>]]]) Per request, throw the BESError <error_type> (default: internal error) with probability <p_error>, sleep for a time drawn from <dist> (default: \"constant:1000:0\", see sleep_dist) with probability <p_delay> or call abort() with probability <p_abort>.";
+ChaosFunc::ChaosFunc()
+{
+    setName("chaos");
+    setDescriptionString((string) "This function randomly fails, sleeps or aborts with the given probabilities.");
+    setUsageString(chaos_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/chaos");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::chaos_ssf);
+    setFunction(dap4_function<debug_function::chaos_ssf>);
+    setVersion("1.0");
+}
+
+/**
+ * Parse "<dist>:<p1>:<p2>".
+ *
+ * @return An empty string on success, else what is wrong
+ */
+static string parse_delay(const string &spec, DelayDistribution &dist, double &p1, double &p2)
+{
+    string::size_type colon1 = spec.find(':');
+    string::size_type colon2 = colon1 == string::npos ? string::npos : spec.find(':', colon1 + 1);
+    if (colon2 == string::npos) return "The delay must be given as \"<dist>:<p1>:<p2>\".";
+
+    if (!get_delay_distribution(spec.substr(0, colon1), dist)) return "Unknown delay distribution.";
+
+    string p1_str = spec.substr(colon1 + 1, colon2 - colon1 - 1);
+    string p2_str = spec.substr(colon2 + 1);
+    char *end;
+    p1 = strtod(p1_str.c_str(), &end);
+    if (p1_str.empty() || *end != '\0') return "The first delay parameter is not a number.";
+    p2 = strtod(p2_str.c_str(), &end);
+    if (p2_str.empty() || *end != '\0') return "The second delay parameter is not a number.";
+
+    return check_delay_parameters(dist, p1, p2);
+}
+
+void chaos_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("chaos", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 3 || argc > 6) {
+        msg << "Missing probability parameter!  USAGE: " << chaos_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    double p_error, p_delay, p_abort;
+    if (!get_double_arg(argv[0], p_error) || !get_double_arg(argv[1], p_delay) || !get_double_arg(argv[2], p_abort)
+        || p_error < 0 || p_delay < 0 || p_abort < 0 || p_error + p_delay + p_abort > 1.0) {
+        msg << "The probabilities must be numbers between 0 and 1 whose sum is at most 1.  USAGE: " << chaos_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    libdap::dods_int32 error_type = BES_INTERNAL_ERROR;
+    if (argc >= 4) {
+        libdap::Int32 *param4 = dynamic_cast<libdap::Int32*>(argv[3]);
+        if (!param4) {
+            msg << "This function only accepts integer values for the error type parameter.  USAGE: " << chaos_usage;
+            response->set_value(msg.str());
+            return;
+        }
+        error_type = param4->value();
+        if (!is_bes_error_type(error_type)) {
+            msg << "Unknown error type " << error_type << ".  USAGE: " << chaos_usage;
+            response->set_value(msg.str());
+            return;
+        }
+    }
+
+    DelayDistribution dist = delay_constant;
+    double p1 = 1000.0, p2 = 0.0;
+    if (argc >= 5) {
+        libdap::Str *param5 = dynamic_cast<libdap::Str*>(argv[4]);
+        string problem = param5 ? parse_delay(param5->value(), dist, p1, p2) : "The delay must be a string.";
+        if (!problem.empty()) {
+            msg << problem << "  USAGE: " << chaos_usage;
+            response->set_value(msg.str());
+            return;
+        }
+    }
+
+    uint64_t seed;
+    if (argc == 6) {
+        long long seed_param;
+        if (!get_integer_arg(argv[5], seed_param)) {
+            msg << "This function only accepts integer values for the seed.  USAGE: " << chaos_usage;
+            response->set_value(msg.str());
+            return;
+        }
+
+        seed = RandomSource::seeded(seed_param);
+    }
+    else {
+        seed = RandomSource::make_seed();
+    }
+
+    RandomSource random(seed);
+    double draw = random.uniform();
+
+    BESDEBUG("DebugFunctions", "chaos_ssf() - drew " << draw << std::endl);
+
+    if (draw < p_abort) {
+        probe.leave();
+        abort();
+    }
+    else if (draw < p_abort + p_error) {
+        throw_bes_error(error_type, "chaos_ssf", msg);
+    }
+    else if (draw < p_abort + p_error + p_delay) {
+        double drawn = draw_delay_ms(dist, p1, p2, random);
+        bool cut_short;
+        double slept = sleep_ms(drawn, Deadline::current_request(), cut_short);
+        msg << "Chaos: delay. Drew " << drawn << " ms; slept for " << slept << " ms"
+            << (cut_short ? "; cut short by the BES timeout." : ".");
+    }
+    else {
+        msg << "Chaos: none.";
+    }
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
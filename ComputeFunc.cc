@@ -0,0 +1,435 @@
+// ComputeFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "ComputeFunc.h"
+
+namespace debug_function {
+
+#define MAX_COMPUTE_THREADS 1024
+
+// The most memory one call may allocate for its data
+#define MAX_COMPUTE_BYTES (1024LL * 1024 * 1024)
+
+// The largest matrix multiplied
+#define MAX_COMPUTE_MATRIX 2048
+
+// Passes the stencil makes over the grid
+#define COMPUTE_STENCIL_SWEEPS 10
+
+// Elements (or bytes) the 1-D kernels work through between checks of
+// the request deadline
+#define COMPUTE_DEADLINE_BLOCK (1024 * 1024)
+
+enum ComputeKernel {
+    kernel_reduction, kernel_stencil, kernel_matmul, kernel_hash, kernel_byteswap, kernel_count
+};
+
+static const char *compute_kernel_names[kernel_count] = { "reduction", "stencil", "matmul", "hash", "byteswap" };
+
+// What one operation is, for each kernel
+static const char *compute_kernel_ops[kernel_count] = { "adds", "point updates", "multiply-adds", "bytes",
+    "values" };
+
+/**
+ * The data the kernels work on. Only the members a kernel uses are
+ * allocated.
+ */
+struct ComputeData {
+    std::vector<float> floats;          // reduction
+    std::vector<double> grid;           // stencil input, and matmul A
+    std::vector<double> grid_out;       // stencil output, and matmul B
+    std::vector<double> product;        // matmul C
+    std::vector<unsigned char> bytes;   // hash
+    std::vector<uint64_t> values;       // byteswap
+    size_t side;                        // stencil and matmul rows and columns
+};
+
+/**
+ * One thread's share of a kernel: elements (or rows) [begin, end).
+ */
+struct ComputeWorker {
+    int kernel;
+    ComputeData *data;
+    size_t begin;
+    size_t end;
+    Deadline deadline;
+    size_t done;        // items finished
+    double result;      // kept so the work is not optimized away
+    bool cut_short;
+};
+
+static void reduction(ComputeWorker *w)
+{
+    const std::vector<float> &x = w->data->floats;
+    float sum = 0.0f;
+    for (size_t block = w->begin; block < w->end; block += COMPUTE_DEADLINE_BLOCK) {
+        if (w->deadline.expired()) {
+            w->cut_short = true;
+            break;
+        }
+        size_t end = std::min(w->end, block + COMPUTE_DEADLINE_BLOCK);
+        for (size_t i = block; i < end; ++i)
+            sum += x[i];
+        w->done = end - w->begin;
+    }
+    w->result = sum;
+}
+
+/**
+ * One sweep of a 5-point (Jacobi) stencil over rows [begin, end) of the
+ * grid's interior.
+ */
+static void stencil(ComputeWorker *w)
+{
+    size_t side = w->data->side;
+    const double *in = &w->data->grid[0];
+    double *out = &w->data->grid_out[0];
+    for (size_t row = w->begin; row < w->end; ++row) {
+        for (size_t col = 1; col < side - 1; ++col) {
+            size_t i = row * side + col;
+            out[i] = 0.2 * (in[i] + in[i - 1] + in[i + 1] + in[i - side] + in[i + side]);
+        }
+    }
+    w->done = w->end - w->begin;
+    w->result = out[w->begin * side + 1];
+}
+
+/**
+ * Rows [begin, end) of C = A * B, in i-k-j order so the inner loop runs
+ * along rows of B and C.
+ */
+static void matmul(ComputeWorker *w)
+{
+    size_t n = w->data->side;
+    const double *a = &w->data->grid[0];
+    const double *b = &w->data->grid_out[0];
+    double *c = &w->data->product[0];
+    for (size_t i = w->begin; i < w->end; ++i) {
+        if (w->deadline.expired()) {
+            w->cut_short = true;
+            break;
+        }
+        double *c_row = c + i * n;
+        for (size_t j = 0; j < n; ++j)
+            c_row[j] = 0.0;
+        for (size_t k = 0; k < n; ++k) {
+            double a_ik = a[i * n + k];
+            const double *b_row = b + k * n;
+            for (size_t j = 0; j < n; ++j)
+                c_row[j] += a_ik * b_row[j];
+        }
+        w->done = i + 1 - w->begin;
+    }
+    w->result = c[w->begin * n];
+}
+
+/**
+ * 64-bit FNV-1a over bytes [begin, end). Each byte depends on the last,
+ * as in the checksums handlers compute over blocks of data.
+ */
+static void hash(ComputeWorker *w)
+{
+    const unsigned char *x = &w->data->bytes[0];
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t block = w->begin; block < w->end; block += COMPUTE_DEADLINE_BLOCK) {
+        if (w->deadline.expired()) {
+            w->cut_short = true;
+            break;
+        }
+        size_t end = std::min(w->end, block + COMPUTE_DEADLINE_BLOCK);
+        for (size_t i = block; i < end; ++i) {
+            h ^= x[i];
+            h *= 1099511628211ULL;
+        }
+        w->done = end - w->begin;
+    }
+    w->result = (double) (h >> 11);
+}
+
+/**
+ * Swap the bytes of the 8-byte values [begin, end) in place, as a
+ * handler does with big-endian Float64 data.
+ */
+static void byteswap(ComputeWorker *w)
+{
+    uint64_t *x = &w->data->values[0];
+    for (size_t block = w->begin; block < w->end; block += COMPUTE_DEADLINE_BLOCK) {
+        if (w->deadline.expired()) {
+            w->cut_short = true;
+            break;
+        }
+        size_t end = std::min(w->end, block + COMPUTE_DEADLINE_BLOCK);
+        for (size_t i = block; i < end; ++i)
+            x[i] = __builtin_bswap64(x[i]);
+        w->done = end - w->begin;
+    }
+    w->result = (double) (x[w->begin] >> 11);
+}
+
+static void *compute_worker(void *arg)
+{
+    ComputeWorker *w = static_cast<ComputeWorker*>(arg);
+    switch (w->kernel) {
+    case kernel_reduction:
+        reduction(w);
+        break;
+    case kernel_stencil:
+        stencil(w);
+        break;
+    case kernel_matmul:
+        matmul(w);
+        break;
+    case kernel_hash:
+        hash(w);
+        break;
+    default:
+        byteswap(w);
+        break;
+    }
+    return 0;
+}
+
+/*****************************************************************************************
+ * 
+ * Compute Function (Debug Functions)
+ * 
+ * This server side function runs one of several compute kernels that
+ * stand in for the work data handlers do, split over nthreads threads,
+ * and reports the operations per second:
+ *  - reduction: sum n floats (ops are adds)
+ *  - stencil: 10 sweeps of a 5-point stencil over a grid of about n
+ *    points, like regridding (ops are point updates)
+ *  - matmul: multiply two n x n matrices of doubles (ops are
+ *    multiply-adds, n^3)
+ *  - hash: 64-bit FNV-1a over n bytes, like a checksum (ops are bytes)
+ *  - byteswap: swap the bytes of n bytes of 8-byte values in place, like
+ *    reading big-endian data (ops are values)
+ *
+ * Each call allocates and fills its data first; only the kernel is
+ * timed. The 1-D kernels give each thread its own part of the data;
+ * hash then computes one hash per part.
+ *
+ */
+string compute_usage = "compute(\"reduction\"|\"stencil\"|\"matmul\"|\"hash\"|\"byteswap\", <n> [,<nthreads>]) Run the compute kernel over a problem of size <n> on <nthreads> threads (default 1) and report the operations per second.";
+ComputeFunc::ComputeFunc()
+{
+    setName("compute");
+    setDescriptionString((string) "This function runs a compute kernel and reports the operations per second.");
+    setUsageString(compute_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/compute");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::compute_ssf);
+    setFunction(dap4_function<debug_function::compute_ssf>);
+    setVersion("1.0");
+}
+
+/**
+ * Allocate and fill the data for 'kernel'. Return the number of work
+ * items to divide among the threads (elements, or rows for stencil and
+ * matmul) and set 'item_ops' to the operations one item takes (for the
+ * stencil, in one sweep), or return 0 and write the reason to 'msg' if
+ * n is out of range.
+ */
+static size_t make_compute_data(int kernel, long long n, ComputeData &data, double &item_ops, std::ostream &msg)
+{
+    switch (kernel) {
+    case kernel_reduction:
+        if (n > MAX_COMPUTE_BYTES / (long long) sizeof(float)) break;
+        data.floats.resize(n);
+        for (long long i = 0; i < n; ++i)
+            data.floats[i] = (float) (i % 1000) * 0.001f;
+        item_ops = 1;
+        return n;
+
+    case kernel_stencil: {
+        size_t side = (size_t) std::sqrt((double) n);
+        if (side < 3 || n > MAX_COMPUTE_BYTES / (2 * (long long) sizeof(double))) break;
+        data.side = side;
+        data.grid.resize(side * side);
+        for (size_t i = 0; i < side * side; ++i)
+            data.grid[i] = (double) (i % side);
+        data.grid_out = data.grid;
+        item_ops = side - 2;
+        return side - 2;
+    }
+
+    case kernel_matmul:
+        if (n > MAX_COMPUTE_MATRIX) break;
+        data.side = n;
+        data.grid.resize(n * n);
+        data.grid_out.resize(n * n);
+        data.product.resize(n * n);
+        for (long long i = 0; i < n * n; ++i) {
+            data.grid[i] = (double) (i % 7);
+            data.grid_out[i] = (double) (i % 5);
+        }
+        item_ops = (double) n * n;
+        return n;
+
+    case kernel_hash:
+        if (n > MAX_COMPUTE_BYTES) break;
+        data.bytes.resize(n);
+        for (long long i = 0; i < n; ++i)
+            data.bytes[i] = (unsigned char) (i * 31);
+        item_ops = 1;
+        return n;
+
+    default:
+        if (n < (long long) sizeof(uint64_t) || n > MAX_COMPUTE_BYTES) break;
+        data.values.resize(n / sizeof(uint64_t));
+        for (size_t i = 0; i < data.values.size(); ++i)
+            data.values[i] = i;
+        item_ops = 1;
+        return data.values.size();
+    }
+
+    msg << "The size is out of range for " << compute_kernel_names[kernel] << " (at most " << MAX_COMPUTE_BYTES
+        << " bytes of data, or a " << MAX_COMPUTE_MATRIX << " x " << MAX_COMPUTE_MATRIX << " matrix).  USAGE: "
+        << compute_usage;
+    return 0;
+}
+
+void compute_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("compute", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 2 || argc > 3) {
+        msg << "Missing kernel or size!  USAGE: " << compute_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    libdap::Str *kernel_param = dynamic_cast<libdap::Str*>(argv[0]);
+    string kernel_name = kernel_param ? BESUtil::lowercase(kernel_param->value()) : "";
+    int kernel = -1;
+    for (int k = 0; k < kernel_count; ++k)
+        if (kernel_name == compute_kernel_names[k]) kernel = k;
+    if (kernel < 0) {
+        msg << "Unknown kernel.  USAGE: " << compute_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    long long n, nthreads = 1;
+    if (!get_integer_arg(argv[1], n) || n < 1) {
+        msg << "The size must be an integer of 1 or more.  USAGE: " << compute_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (argc == 3 && (!get_integer_arg(argv[2], nthreads) || nthreads < 1 || nthreads > MAX_COMPUTE_THREADS)) {
+        msg << "The number of threads must be an integer between 1 and " << MAX_COMPUTE_THREADS << ".  USAGE: "
+            << compute_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    ComputeData data;
+    double item_ops = 0.0;
+    size_t items = make_compute_data(kernel, n, data, item_ops, msg);
+    if (items == 0) {
+        response->set_value(msg.str());
+        return;
+    }
+    if ((long long) items < nthreads) nthreads = items;
+
+    Deadline deadline = Deadline::current_request();
+    std::vector<ComputeWorker> workers(nthreads);
+    size_t share = items / nthreads;
+    for (int t = 0; t < nthreads; ++t) {
+        workers[t].kernel = kernel;
+        workers[t].data = &data;
+        workers[t].begin = t * share;
+        workers[t].end = t == nthreads - 1 ? items : (t + 1) * share;
+        workers[t].deadline = deadline;
+        workers[t].done = 0;
+        workers[t].result = 0.0;
+        workers[t].cut_short = false;
+        // The stencil works on the interior rows, 1 to side - 2
+        if (kernel == kernel_stencil) {
+            workers[t].begin += 1;
+            workers[t].end += 1;
+        }
+    }
+
+    bool cut_short = false;
+    int started = 0;
+    int sweeps = 1;
+    uint64_t start = monotonic_ns();
+    if (kernel == kernel_stencil) {
+        // Each sweep reads what the last one wrote, so the threads finish
+        // a sweep before the next starts
+        for (sweeps = 0; sweeps < COMPUTE_STENCIL_SWEEPS; ++sweeps) {
+            if (deadline.expired()) {
+                cut_short = true;
+                break;
+            }
+            started = run_workers(compute_worker, workers);
+            data.grid.swap(data.grid_out);
+        }
+    }
+    else {
+        started = run_workers(compute_worker, workers);
+    }
+    double elapsed = (monotonic_ns() - start) / 1.0e6;
+
+    double result = 0.0;
+    long long done = 0;
+    for (int t = 0; t < started; ++t) {
+        result += workers[t].result;
+        done += workers[t].done;
+        if (workers[t].cut_short) cut_short = true;
+    }
+    long long ops = (long long) (done * item_ops * sweeps);
+
+    BESDEBUG("DebugFunctions", "compute_ssf() - " << kernel_name << " of " << n << " in " << elapsed << " ms, result " << result << std::endl);
+
+    msg << "Ran " << kernel_name << " of size " << n << " on " << nthreads << " threads: " << ops << " "
+        << compute_kernel_ops[kernel] << " in " << elapsed << " ms, " << (elapsed > 0 ? ops / (elapsed / 1.0e3) : 0.0)
+        << " ops/s.";
+    if (started < nthreads) msg << " (" << nthreads - started << " threads could not be started.)";
+    if (cut_short) msg << " Cut short by the BES timeout.";
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
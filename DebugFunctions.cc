@@ -22,17 +22,45 @@
 //
 // You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
 
+#include "config.h"
+
 #include <sstream>      // std::stringstream
 #include <stdlib.h>     /* abort, NULL */
+#include <string.h>
+#include <errno.h>
 #include <iostream>
 
 #include <sys/time.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <sched.h>
 
 #include "DebugFunctions.h"
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "SynthArrayFunc.h"
+#include "FunctionStats.h"
+#include "SleepDistFunc.h"
+#include "ChaosFunc.h"
+#include "TouchVarsFunc.h"
+#include "IoReadFunc.h"
+#include "IoPatternFunc.h"
+#include "CacheFunc.h"
+#include "ErrorStormFunc.h"
+#include "TrickleFunc.h"
+#include "SynthDdsFunc.h"
+#include "RusageFunc.h"
+#include "MembwFunc.h"
+#include "ComputeFunc.h"
+#include "BarrierFunc.h"
+#include "ForkProbeFunc.h"
+#include "Trace.h"
 
 #include "ServerFunctionsList.h"
 #include "BESDebug.h"
+#include "BESUtil.h"
 #include <Int32.h>
 #include <Structure.h>
 #include <Str.h>
@@ -72,12 +100,90 @@ void DebugFunctions::initialize(const string &/*modname*/)
     debug_function::SleepFunc *sleepFunc = new debug_function::SleepFunc();
     libdap::ServerFunctionsList::TheList()->add_function(sleepFunc);
 
+    debug_function::AllocFunc *allocFunc = new debug_function::AllocFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(allocFunc);
+
     debug_function::SumUntilFunc *sumUntilFunc = new debug_function::SumUntilFunc();
     libdap::ServerFunctionsList::TheList()->add_function(sumUntilFunc);
 
     debug_function::ErrorFunc *errorFunc = new debug_function::ErrorFunc();
     libdap::ServerFunctionsList::TheList()->add_function(errorFunc);
 
+    debug_function::SumNFunc *sumNFunc = new debug_function::SumNFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(sumNFunc);
+
+    debug_function::SleepDistFunc *sleepDistFunc = new debug_function::SleepDistFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(sleepDistFunc);
+
+    debug_function::ChaosFunc *chaosFunc = new debug_function::ChaosFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(chaosFunc);
+
+    debug_function::SynthArrayFunc *synthArrayFunc = new debug_function::SynthArrayFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(synthArrayFunc);
+
+    debug_function::TouchVarsFunc *touchVarsFunc = new debug_function::TouchVarsFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(touchVarsFunc);
+
+    debug_function::IoReadFunc *ioReadFunc = new debug_function::IoReadFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(ioReadFunc);
+
+    debug_function::IoPatternFunc *ioPatternFunc = new debug_function::IoPatternFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(ioPatternFunc);
+
+    debug_function::DropCacheFunc *dropCacheFunc = new debug_function::DropCacheFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(dropCacheFunc);
+
+    debug_function::WarmCacheFunc *warmCacheFunc = new debug_function::WarmCacheFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(warmCacheFunc);
+
+    debug_function::ErrorStormFunc *errorStormFunc = new debug_function::ErrorStormFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(errorStormFunc);
+
+    debug_function::TrickleFunc *trickleFunc = new debug_function::TrickleFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(trickleFunc);
+
+    debug_function::SynthDdsFunc *synthDdsFunc = new debug_function::SynthDdsFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(synthDdsFunc);
+
+    debug_function::RusageFunc *rusageFunc = new debug_function::RusageFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(rusageFunc);
+
+    debug_function::MembwFunc *membwFunc = new debug_function::MembwFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(membwFunc);
+
+    debug_function::ComputeFunc *computeFunc = new debug_function::ComputeFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(computeFunc);
+
+    debug_function::BarrierFunc *barrierFunc = new debug_function::BarrierFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(barrierFunc);
+
+    debug_function::ForkProbeFunc *forkProbeFunc = new debug_function::ForkProbeFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(forkProbeFunc);
+
+    double ops_per_ms = calibrate_sum_until();
+    BESDEBUG("DebugFunctions", "initialize() - sum_until calibration: " << ops_per_ms << " ops/ms" << std::endl);
+
+    // The statistics live in memory shared with the listeners this process
+    // forks. Our functions are always timed, every other function
+    // registered so far only if asked. The stats functions are added
+    // afterward so they are not timed.
+    bool shared = create_shared_stats();
+    if (!create_shared_seed_count())
+        BESDEBUG("DebugFunctions", "initialize() - seeded draws are counted per-process" << std::endl);
+    int wrapped = instrument_server_functions(get_bool_key(DEBUG_FUNCTIONS_INSTRUMENT_KEY, false));
+    BESDEBUG("DebugFunctions", "initialize() - timing " << wrapped << " functions, stats are "
+        << (shared ? "shared" : "per-process") << std::endl);
+
+    debug_function::FunctionStatsFunc *functionStatsFunc = new debug_function::FunctionStatsFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(functionStatsFunc);
+
+    debug_function::StatsDumpFunc *statsDumpFunc = new debug_function::StatsDumpFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(statsDumpFunc);
+
+    init_trace();
+    debug_function::TraceDumpFunc *traceDumpFunc = new debug_function::TraceDumpFunc();
+    libdap::ServerFunctionsList::TheList()->add_function(traceDumpFunc);
+
     BESDEBUG("DebugFunctions", "initialize() - function names: " << getFunctionNames() << std::endl);
 
     BESDEBUG("DebugFunctions", "initialize() - END" << std::endl);
@@ -115,11 +221,13 @@ AbortFunc::AbortFunc()
     setRole("http://services.opendap.org/dap4/server-side-function/debug/abort");
     setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
     setFunction(debug_function::abort_ssf);
+    setFunction(dap4_function<debug_function::abort_ssf>);
     setVersion("1.0");
 }
 
 void abort_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
 {
+    FunctionProbe probe("abort", argc, argv);
 
     std::stringstream msg;
     libdap::Str *response = new libdap::Str("info");
@@ -138,6 +246,7 @@ void abort_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseT
 
             usleep(milliseconds * 1000);
             msg << "abort now. " << endl;
+            probe.leave();
             abort();
             return;
         }
@@ -160,6 +269,9 @@ void abort_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseT
  * This server side function calls sleep() for the number 
  * of millisecs passed in at argv[0]. (Zzzzzzzzzzzzzzz)
  *
+ * @note If the BES would time out the request first, the function wakes
+ * up just before that and says the sleep was cut short.
+ *
  */
 
 string sleep_usage = "sleep(##) where ## is the number of milliseconds to sleep.";
@@ -171,11 +283,14 @@ SleepFunc::SleepFunc()
     setRole("http://services.opendap.org/dap4/server-side-function/debug/sleep");
     setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
     setFunction(debug_function::sleep_ssf);
+    setFunction(dap4_function<debug_function::sleep_ssf>);
     setVersion("1.0");
 }
 
 void sleep_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
 {
+    TraceSpan span("sleep_ssf");
+    FunctionProbe probe("sleep", argc, argv);
 
     std::stringstream msg;
     libdap::Str *sleep_info = new libdap::Str("info");
@@ -193,8 +308,13 @@ void sleep_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseT
         libdap::Int32 *param1 = dynamic_cast<libdap::Int32*>(argv[0]);
         if (param1) {
             libdap::dods_int32 milliseconds = param1->value();
-            usleep(milliseconds * 1000);
-            msg << "Slept for " << milliseconds << " ms.";
+            bool cut_short;
+            double slept = sleep_ms(milliseconds, Deadline::current_request(), cut_short);
+            if (cut_short)
+                msg << "Slept for " << (long long) slept << " of " << milliseconds
+                    << " ms; cut short by the BES timeout.";
+            else
+                msg << "Slept for " << milliseconds << " ms.";
         }
         else {
             msg << "This function only accepts integer values " << "for the time (in milliseconds) parameter.  USAGE: "
@@ -216,6 +336,202 @@ void sleep_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseT
 }
 ;
 
+/*****************************************************************************************
+ * 
+ * Alloc Function (Debug Functions)
+ * 
+ * This server side function allocates a block of memory, faults every
+ * page of it in using one of several access patterns, holds it for a
+ * while and then releases it. It reports the page faults taken and the
+ * time spent faulting so the cost of growing a listener's RSS can be
+ * measured.
+ *
+ * @note The memory comes from mmap() rather than malloc() so that it is
+ * page aligned (needed for madvise()) and really returned to the OS when
+ * the function is done.
+ *
+ */
+// Upper bound on the size of one alloc; also keeps rounding the size up
+// to whole pages from overflowing.
+#define MAX_ALLOC_BYTES (1LL << 40)
+
+string alloc_usage = "alloc(<bytes>, <ms> [,\"sequential\"|\"strided\"|\"random\"|\"none\" [,0|1]]) Allocate <bytes>, touch each page in the given order (default: sequential), hold the memory for <ms> milliseconds and free it; 0|1 ask for transparent huge pages.";
+AllocFunc::AllocFunc()
+{
+    setName("alloc");
+    setDescriptionString((string) "This function allocates, touches and holds memory for the specified number of millisecs.");
+    setUsageString(alloc_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/alloc");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::alloc_ssf);
+    setFunction(dap4_function<debug_function::alloc_ssf>);
+    setVersion("1.0");
+}
+
+// Pages touched between two in the strided pattern (64KB with 4KB pages)
+#define ALLOC_TOUCH_STRIDE 16
+
+enum TouchPattern {
+    touch_none, touch_sequential, touch_strided, touch_random
+};
+
+static long long gcd(long long a, long long b)
+{
+    while (b != 0) {
+        long long t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**
+ * Write one byte in each of the 'npages' pages that start at 'mem'.
+ */
+static void touch_pages(char *mem, long long npages, long page_size, TouchPattern pattern)
+{
+    switch (pattern) {
+    case touch_none:
+        break;
+
+    case touch_sequential:
+        for (long long page = 0; page < npages; ++page)
+            mem[page * page_size] = 1;
+        break;
+
+    case touch_strided:
+        for (long long first = 0; first < ALLOC_TOUCH_STRIDE && first < npages; ++first)
+            for (long long page = first; page < npages; page += ALLOC_TOUCH_STRIDE)
+                mem[page * page_size] = 1;
+        break;
+
+    case touch_random: {
+        // i * step mod npages visits every page exactly once when step and
+        // npages are relatively prime; no index array is needed.
+        long long step = 2654435761LL % npages;
+        if (step == 0) step = 1;
+        while (gcd(step, npages) != 1)
+            ++step;
+        long long page = 0;
+        for (long long i = 0; i < npages; ++i) {
+            mem[page * page_size] = 1;
+            page += step;
+            if (page >= npages) page -= npages;
+        }
+        break;
+    }
+    }
+}
+
+void alloc_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("alloc", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    long long bytes;
+    libdap::Int32 *param2 = argc >= 2 ? dynamic_cast<libdap::Int32*>(argv[1]) : 0;
+    if (argc < 2 || argc > 4) {
+        msg << "Missing size or time parameter!  USAGE: " << alloc_usage;
+    }
+    else if (!get_integer_arg(argv[0], bytes) || bytes < 1 || !param2) {
+        msg << "This function only accepts integer values " << "for the size (in bytes) and time (in milliseconds) parameters.  USAGE: "
+            << alloc_usage;
+    }
+    else if (bytes > MAX_ALLOC_BYTES) {
+        msg << "The size must be at most " << MAX_ALLOC_BYTES << " bytes.  USAGE: " << alloc_usage;
+    }
+
+    TouchPattern pattern = touch_sequential;
+    if (msg.str().empty() && argc >= 3) {
+        libdap::Str *temp = dynamic_cast<libdap::Str*>(argv[2]);
+        string name = temp ? BESUtil::lowercase(temp->value()) : "";
+        if (name == "sequential")
+            pattern = touch_sequential;
+        else if (name == "strided")
+            pattern = touch_strided;
+        else if (name == "random")
+            pattern = touch_random;
+        else if (name == "none")
+            pattern = touch_none;
+        else
+            msg << "Unknown touch pattern.  USAGE: " << alloc_usage;
+    }
+
+    bool hugepages = false;
+    if (argc == 4) {
+        libdap::Int32 *temp = dynamic_cast<libdap::Int32*>(argv[3]);
+        if (temp && temp->value() != 0)
+            hugepages = true;
+    }
+
+    if (!msg.str().empty()) {
+        response->set_value(msg.str());
+        return;
+    }
+
+    libdap::dods_int32 milliseconds = param2->value();
+    Deadline deadline = Deadline::current_request();
+    long page_size = sysconf(_SC_PAGESIZE);
+    long long npages = (bytes + page_size - 1) / page_size;
+    size_t length = npages * page_size;
+
+    double start_time = monotonic_ms();
+    void *mem = mmap(0, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+        msg << "Could not allocate " << bytes << " bytes: " << strerror(errno);
+        response->set_value(msg.str());
+        return;
+    }
+    double alloc_time = monotonic_ms() - start_time;
+
+    bool advised = false;
+#ifdef MADV_HUGEPAGE
+    if (hugepages) advised = (madvise(mem, length, MADV_HUGEPAGE) == 0);
+#endif
+
+    struct rusage before, after;
+#ifdef RUSAGE_THREAD
+    int who = RUSAGE_THREAD;
+#else
+    int who = RUSAGE_SELF;
+#endif
+    getrusage(who, &before);
+    start_time = monotonic_ms();
+
+    touch_pages(static_cast<char*>(mem), npages, page_size, pattern);
+
+    double touch_time = monotonic_ms() - start_time;
+    getrusage(who, &after);
+
+    bool cut_short;
+    double held = sleep_ms(milliseconds, deadline, cut_short);
+
+    start_time = monotonic_ms();
+    munmap(mem, length);
+    double free_time = monotonic_ms() - start_time;
+
+    long minor = after.ru_minflt - before.ru_minflt;
+    long major = after.ru_majflt - before.ru_majflt;
+
+    msg << "Allocated " << length << " bytes (" << npages << " pages of " << page_size << " bytes) in " << alloc_time
+        << " ms.";
+    if (hugepages) msg << (advised ? " MADV_HUGEPAGE set." : " MADV_HUGEPAGE failed or is not supported.");
+    msg << " Touched " << (pattern == touch_none ? 0 : npages) << " pages in " << touch_time << " ms; minor faults: "
+        << minor << " major faults: " << major;
+    if (minor + major > 0) msg << " (" << touch_time * 1.0e6 / (minor + major) << " ns/fault)";
+    if (cut_short)
+        msg << ". Held for " << held << " of " << milliseconds << " ms; cut short by the BES timeout.";
+    else
+        msg << ". Held for " << milliseconds << " ms.";
+    msg << " Freed in " << free_time << " ms.";
+
+    response->set_value(msg.str());
+    return;
+}
+
 /*****************************************************************************************
  * 
  * SumUntil (Debug Functions)
@@ -227,9 +543,18 @@ void sleep_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseT
  * When this is used in tests, the value reached can vary, so to make
  * checking for success/failure, the value can be omitted.
  *
+ * @note The optional third argument runs the sum on that many threads
+ * at once so that several cores can be saturated by one request. The
+ * optional fourth argument, when not 0, pins each thread to a distinct
+ * CPU taken from the beslistener's affinity mask. In this mode the
+ * per-thread term counts and the aggregate ops/ms are reported.
+ *
+ * @note The sum stops just before the BES would time out the request
+ * and the response says it was cut short.
+ *
  */
 
-string sum_until_usage = "sum_until(<val> [,0|<true>]) Compute a sum until <val> of milliseconds has elapsed; 0|<true> print the sum value.";
+string sum_until_usage = "sum_until(<val> [,0|<true> [,<nthreads> [,0|1]]]) Compute a sum until <val> of milliseconds has elapsed; 0|<true> print the sum value; <nthreads> sum on that many threads; 0|1 pin each thread to its own CPU.";
 SumUntilFunc::SumUntilFunc()
 {
     setName("sum_until");
@@ -238,17 +563,344 @@ SumUntilFunc::SumUntilFunc()
     setRole("http://services.opendap.org/dap4/server-side-function/debug/sum_until");
     setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
     setFunction(debug_function::sum_until_ssf);
-    setVersion("1.0");
+    setFunction(dap4_function<debug_function::sum_until_ssf>);
+    setVersion("1.1");
+}
+
+// Upper bound on the number of threads one sum_until call may start.
+#define MAX_SUM_UNTIL_THREADS 1024
+
+// Number of terms summed between reads of the clock. Large enough that the
+// clock call does not dominate the loop, small enough (a few us) that the
+// time limit is still honored closely.
+#define SUM_UNTIL_BATCH 1024
+
+// Batches sum_n() computes between checks of the request deadline.
+#define SUM_N_DEADLINE_BATCHES 64
+
+// How long DebugFunctions::initialize() spends measuring the sum rate.
+#define SUM_UNTIL_CALIBRATION_MS 50
+
+// Terms per ms measured by calibrate_sum_until(); 0 until it has run.
+static double sum_until_ops_per_ms = 0.0;
+
+// The final term of each sum is stored here so the compiler cannot discard
+// the loops that compute it. The sum threads store to it at the same time,
+// so use keep_term().
+static unsigned long sum_until_sink;
+
+static inline void keep_term(unsigned long term)
+{
+    __sync_lock_test_and_set(&sum_until_sink, term);
+}
+
+/**
+ * Compute 'count' more Fibonacci terms, continuing from the state in
+ * 'one_past' and 'two_past'. The terms are unsigned so that the
+ * (inevitable) overflow wraps instead of being undefined.
+ */
+static inline void fib_terms(long long count, unsigned long &one_past, unsigned long &two_past)
+{
+    for (long long i = 0; i < count; ++i) {
+        unsigned long fib = one_past + two_past;
+        two_past = one_past;
+        one_past = fib;
+    }
+}
+
+/**
+ * Compute Fibonacci terms until 'milliseconds' have elapsed or 'deadline'
+ * has passed. The monotonic clock is read once every SUM_UNTIL_BATCH terms.
+ *
+ * @param milliseconds How long to sum
+ * @param deadline Stop at this deadline, even if 'milliseconds' have not
+ * elapsed
+ * @param elapsed Value-result parameter; the number of ms actually spent
+ * @param cut_short Value-result parameter; true if the deadline stopped
+ * the sum
+ * @return The number of terms computed
+ */
+static long long fib_sum_until(libdap::dods_int32 milliseconds, const Deadline &deadline, double &elapsed,
+    bool &cut_short)
+{
+    unsigned long one_past = 1;
+    unsigned long two_past = 0;
+    long long n = 1;
+
+    uint64_t start_time = monotonic_ns();
+    uint64_t stop_time = start_time + (uint64_t) (milliseconds > 0 ? milliseconds : 0) * 1000000ULL;
+    cut_short = false;
+    if (deadline.is_set() && deadline.ns() < stop_time) {
+        stop_time = deadline.ns();
+        cut_short = true;
+    }
+
+    uint64_t end_time = start_time;
+    while (end_time < stop_time) {
+        fib_terms(SUM_UNTIL_BATCH, one_past, two_past);
+        n += SUM_UNTIL_BATCH;
+        end_time = monotonic_ns();
+    }
+
+    keep_term(one_past);
+    elapsed = (end_time - start_time) / 1.0e6;
+    return n;
+}
+
+/**
+ * Compute exactly 'terms' Fibonacci terms, unless 'deadline' passes first.
+ * The terms are computed in the same batches fib_sum_until() uses so that
+ * the two run the same code and their rates can be compared; when there
+ * is a deadline it is checked every SUM_N_DEADLINE_BATCHES batches.
+ *
+ * @param terms How many terms to compute
+ * @param deadline Stop at this deadline, even if not all the terms are done
+ * @param elapsed Value-result parameter; the number of ms spent
+ * @param cut_short Value-result parameter; true if the deadline stopped
+ * the sum
+ * @return The number of terms computed
+ */
+static long long fib_sum_n(long long terms, const Deadline &deadline, double &elapsed, bool &cut_short)
+{
+    unsigned long one_past = 1;
+    unsigned long two_past = 0;
+    long long n = 0;
+
+    cut_short = false;
+    double start_time = monotonic_ms();
+    for (long long batches = terms / SUM_UNTIL_BATCH; batches > 0; --batches) {
+        fib_terms(SUM_UNTIL_BATCH, one_past, two_past);
+        n += SUM_UNTIL_BATCH;
+        if (deadline.is_set() && batches % SUM_N_DEADLINE_BATCHES == 0 && deadline.expired()) {
+            cut_short = true;
+            break;
+        }
+    }
+    if (!cut_short) {
+        fib_terms(terms % SUM_UNTIL_BATCH, one_past, two_past);
+        n = terms;
+    }
+    elapsed = monotonic_ms() - start_time;
+
+    keep_term(one_past);
+    return n;
+}
+
+double calibrate_sum_until()
+{
+    double elapsed;
+    bool cut_short;
+    long long n = fib_sum_until(SUM_UNTIL_CALIBRATION_MS, Deadline(), elapsed, cut_short);
+    if (elapsed > 0) sum_until_ops_per_ms = n / elapsed;
+
+    return sum_until_ops_per_ms;
+}
+
+double get_sum_until_calibration()
+{
+    return sum_until_ops_per_ms;
+}
+
+/**
+ * State shared between the sum functions and one of their worker threads.
+ */
+struct SumUntilWorker {
+    libdap::dods_int32 milliseconds;
+    long long terms;    // when > 0, compute exactly this many terms
+    Deadline deadline;  // stop here regardless
+    int cpu;            // CPU to pin the thread to; -1 means don't pin
+    bool pinned;        // true if the thread was really pinned to 'cpu'
+    long long n;        // number of terms summed
+    double elapsed;     // ms spent summing
+    bool cut_short;     // true if the deadline stopped the sum
+};
+
+static void *sum_until_worker(void *arg)
+{
+    SumUntilWorker *worker = static_cast<SumUntilWorker*>(arg);
+    TraceSpan span(worker->terms > 0 ? "sum_n_worker" : "sum_until_worker", worker->cpu);
+
+#if HAVE_PTHREAD_SETAFFINITY_NP
+    if (worker->cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker->cpu, &cpus);
+        worker->pinned = (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0);
+    }
+#endif
+
+    if (worker->terms > 0)
+        worker->n = fib_sum_n(worker->terms, worker->deadline, worker->elapsed, worker->cut_short);
+    else
+        worker->n = fib_sum_until(worker->milliseconds, worker->deadline, worker->elapsed, worker->cut_short);
+
+    return 0;
+}
+
+/**
+ * Get the CPUs this process may run on, in ascending order. If the
+ * affinity mask cannot be read, 'cpus' is left empty.
+ */
+static void get_usable_cpus(vector<int> &cpus)
+{
+#if HAVE_SCHED_GETAFFINITY
+    cpu_set_t mask;
+    CPU_ZERO(&mask);
+    if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &mask)) cpus.push_back(cpu);
+    }
+#else
+    (void) cpus;
+#endif
+}
+
+/**
+ * Run the sum on 'nthreads' threads at once and describe the result
+ * in 'msg'. If 'terms' is > 0 each thread computes exactly that many
+ * terms, else each sums for 'milliseconds'.
+ */
+static void parallel_sum(libdap::dods_int32 milliseconds, long long terms, const Deadline &deadline, int nthreads,
+    bool pin, bool print_sum_value, std::stringstream &msg)
+{
+    vector<int> cpus;
+    if (pin) get_usable_cpus(cpus);
+
+    vector<SumUntilWorker> workers(nthreads);
+
+    for (int i = 0; i < nthreads; ++i) {
+        workers[i].milliseconds = milliseconds;
+        workers[i].terms = terms;
+        workers[i].deadline = deadline;
+        workers[i].cpu = cpus.empty() ? -1 : cpus[i % cpus.size()];
+        workers[i].pinned = false;
+        workers[i].n = 0;
+        workers[i].elapsed = 0.0;
+        workers[i].cut_short = false;
+    }
+
+    // Always on threads of their own: a worker may pin its thread
+    int started = run_workers(sum_until_worker, workers, true);
+    if (started == 0) {
+        msg << "Could not start any sum_until threads.";
+        return;
+    }
+
+    long long total = 0;
+    double elapsed = 0.0;
+    int pinned = 0;
+    bool cut_short = false;
+    for (int i = 0; i < started; ++i) {
+        total += workers[i].n;
+        if (workers[i].elapsed > elapsed) elapsed = workers[i].elapsed;
+        if (workers[i].pinned) ++pinned;
+        if (workers[i].cut_short) cut_short = true;
+    }
+
+    if (cut_short && terms > 0)
+        msg << "Summed " << total << " of " << terms * started << " terms on " << started
+            << " threads; cut short by the BES timeout.";
+    else if (cut_short)
+        msg << "Summed for " << (long long) elapsed << " of " << milliseconds << " ms on " << started
+            << " threads; cut short by the BES timeout.";
+    else if (terms > 0)
+        msg << "Summed " << terms << " terms on " << started << " threads.";
+    else
+        msg << "Summed for " << (long long) elapsed << " ms on " << started << " threads.";
+
+    if (started < nthreads) msg << " (" << nthreads - started << " threads could not be started.)";
+
+    if (print_sum_value) {
+        msg << " n: [";
+        for (int i = 0; i < started; ++i) {
+            if (i > 0) msg << ", ";
+            msg << workers[i].n;
+            if (workers[i].pinned) msg << "@cpu" << workers[i].cpu;
+        }
+        msg << "] total: " << total;
+        if (terms > 0) msg << " elapsed: " << elapsed << " ms";
+        if (elapsed > 0) msg << " ops/ms: " << total / elapsed;
+        if (pin) msg << " pinned: " << pinned;
+        msg << " calibrated ops/ms: " << sum_until_ops_per_ms;
+    }
+}
+
+/**
+ * The part of sum_until() and sum_n() that follows the first argument:
+ * read the optional print/nthreads/pin arguments and run the sum.
+ *
+ * @param milliseconds Time limit (timed mode)
+ * @param terms Number of terms (fixed-work mode), 0 for timed mode
+ */
+static void run_sum(libdap::dods_int32 milliseconds, long long terms, const string &usage, int argc,
+    libdap::BaseType * argv[], std::stringstream &msg)
+{
+    Deadline deadline = Deadline::current_request();
+
+    bool print_sum_value = true;
+    // argument #2 is optional
+    if (argc >= 2) {
+        libdap::Int32 *temp = dynamic_cast<libdap::Int32*>(argv[1]);
+        if (temp && temp->value() == 0)
+            print_sum_value = false;
+    }
+
+    // arguments #3 and #4 are optional and select the multi-threaded form
+    if (argc >= 3) {
+        libdap::Int32 *nthreads = dynamic_cast<libdap::Int32*>(argv[2]);
+        if (!nthreads || nthreads->value() < 1 || nthreads->value() > MAX_SUM_UNTIL_THREADS) {
+            msg << "The number of threads must be an integer between 1 and " << MAX_SUM_UNTIL_THREADS
+                << ".  USAGE: " << usage;
+            return;
+        }
+
+        bool pin = false;
+        if (argc == 4) {
+            libdap::Int32 *temp = dynamic_cast<libdap::Int32*>(argv[3]);
+            if (temp && temp->value() != 0)
+                pin = true;
+        }
+
+        parallel_sum(milliseconds, terms, deadline, nthreads->value(), pin, print_sum_value, msg);
+        return;
+    }
+
+    double elapsed;
+    bool cut_short;
+    if (terms > 0) {
+        long long n = fib_sum_n(terms, deadline, elapsed, cut_short);
+
+        if (cut_short)
+            msg << "Summed " << n << " of " << terms << " terms; cut short by the BES timeout.";
+        else if (!print_sum_value)
+            msg << "Summed " << n << " terms.";
+        else
+            msg << "Summed " << n << " terms in " << elapsed << " ms. ops/ms: " << (elapsed > 0 ? n / elapsed : 0)
+                << " calibrated ops/ms: " << sum_until_ops_per_ms;
+    }
+    else {
+        long long n = fib_sum_until(milliseconds, deadline, elapsed, cut_short);
+
+        if (cut_short)
+            msg << "Summed for " << (long long) elapsed << " of " << milliseconds
+                << " ms; cut short by the BES timeout.";
+        else if (!print_sum_value)
+            msg << "Summed for " << (long long) elapsed << " ms.";
+        else
+            msg << "Summed for " << (long long) elapsed << " ms. n: " << n;
+    }
 }
 
 void sum_until_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
 {
+    TraceSpan span("sum_until_ssf");
+    FunctionProbe probe("sum_until", argc, argv);
 
     std::stringstream msg;
     libdap::Str *response = new libdap::Str("info");
     *btpp = response;
 
-    if (!(argc == 1 || argc == 2)) {
+    if (argc < 1 || argc > 4) {
         msg << "Missing time parameter!  USAGE: " << sum_until_usage;
 
         response->set_value(msg.str());
@@ -265,44 +917,64 @@ void sum_until_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::B
         return;
     }
 
-    bool print_sum_value = true;
-    // argument #2 is optional
-    if (argc == 2) {
-        libdap::Int32 *temp = dynamic_cast<libdap::Int32*>(argv[1]);
-        if (temp && temp->value() == 0)
-            print_sum_value = false;
-    }
-    
-    libdap::dods_int32 milliseconds = param1->value();
+    run_sum(param1->value(), 0, sum_until_usage, argc, argv, msg);
 
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    double start_time = (tv.tv_sec) * 1000 + (tv.tv_usec) / 1000; // convert tv_sec & tv_usec to millisecond
-    double end_time = start_time;
+    response->set_value(msg.str());
+    return;
+}
 
-    long fib;
-    long one_past = 1;
-    long two_past = 0;
-    long n = 1;
+/*****************************************************************************************
+ * 
+ * SumN (Debug Functions)
+ * 
+ * This server side function computes exactly the number of terms
+ * passed in at argv[0] of the same sum used by sum_until and reports
+ * the time that took on the monotonic clock. Unlike sum_until the
+ * amount of work is fixed, so the elapsed time (and the ops/ms
+ * figure) can be compared across hosts and builds.
+ *
+ */
 
-    bool done = false;
-    while (!done) {
-        n++;
-        fib = one_past + two_past;
-        two_past = one_past;
-        one_past = fib;
-        gettimeofday(&tv, NULL);
-        end_time = (tv.tv_sec) * 1000 + (tv.tv_usec) / 1000; // convert tv_sec & tv_usec to millisecond
-        if (end_time - start_time >= milliseconds) {
-            done = true;
-        }
+string sum_n_usage = "sum_n(<n> [,0|<true> [,<nthreads> [,0|1]]]) Compute exactly <n> terms of a sum; 0|<true> print the timing; <nthreads> sum on that many threads; 0|1 pin each thread to its own CPU.";
+SumNFunc::SumNFunc()
+{
+    setName("sum_n");
+    setDescriptionString((string) "This function computes a fixed number of terms of a sum and reports the time taken.");
+    setUsageString(sum_n_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/sum_n");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::sum_n_ssf);
+    setFunction(dap4_function<debug_function::sum_n_ssf>);
+    setVersion("1.0");
+}
+
+void sum_n_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("sum_n", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 1 || argc > 4) {
+        msg << "Missing number of terms parameter!  USAGE: " << sum_n_usage;
+
+        response->set_value(msg.str());
+        return;
     }
 
-    if (!print_sum_value)
-        msg << "Summed for " << end_time - start_time << " ms.";
-    else
-        msg << "Summed for " << end_time - start_time << " ms. n: " << n;
-    
+    long long terms;
+    // argument #1 is required
+    if (!get_integer_arg(argv[0], terms) || terms < 1) {
+        msg << "This function only accepts positive integer values " << "for the number of terms parameter.  USAGE: "
+            << sum_n_usage;
+
+        response->set_value(msg.str());
+        return;
+    }
+
+    run_sum(0, terms, sum_n_usage, argc, argv, msg);
+
     response->set_value(msg.str());
     return;
 }
@@ -324,11 +996,83 @@ ErrorFunc::ErrorFunc()
     setRole("http://services.opendap.org/dap4/server-side-function/debug/error");
     setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
     setFunction(debug_function::error_ssf);
+    setFunction(dap4_function<debug_function::error_ssf>);
     setVersion("1.0");
 }
 
+void throw_bes_error(libdap::dods_int32 error_type, const string &location, std::stringstream &msg)
+{
+    DEBUG_PROBE2(function__error, location.c_str(), error_type);
+
+    switch (error_type) {
+
+    case BES_INTERNAL_ERROR: {
+        msg << "A BESInternalError was requested.";
+        BESInternalError error(msg.str(), location, 0);
+        throw error;
+    }
+        break;
+
+    case BES_INTERNAL_FATAL_ERROR: {
+        msg << "A BESInternalFatalError was requested.";
+        BESInternalFatalError error(msg.str(), location, 0);
+        throw error;
+    }
+        break;
+
+    case BES_SYNTAX_USER_ERROR: {
+        msg << "A BESSyntaxUserError was requested.";
+        BESSyntaxUserError error(msg.str(), location, 0);
+        throw error;
+    }
+        break;
+
+    case BES_FORBIDDEN_ERROR: {
+        msg << "A BESForbiddenError was requested.";
+        BESForbiddenError error(msg.str(), location, 0);
+        throw error;
+    }
+        break;
+
+    case BES_NOT_FOUND_ERROR: {
+        msg << "A BESNotFoundError was requested.";
+        BESNotFoundError error(msg.str(), location, 0);
+        throw error;
+    }
+        break;
+
+    case BES_TIMEOUT_ERROR: {
+        msg << "A BESTimeOutError was requested.";
+        BESTimeoutError error(msg.str(), location, 0);
+        throw error;
+    }
+        break;
+
+    default:
+        msg << "An unrecognized error_type parameter was received. Requested error_type: " << error_type;
+        break;
+    }
+}
+
+bool is_bes_error_type(long long error_type)
+{
+    switch (error_type) {
+    case BES_INTERNAL_ERROR:
+    case BES_INTERNAL_FATAL_ERROR:
+    case BES_SYNTAX_USER_ERROR:
+    case BES_FORBIDDEN_ERROR:
+    case BES_NOT_FOUND_ERROR:
+    case BES_TIMEOUT_ERROR:
+        return true;
+    default:
+        return false;
+    }
+}
+
 void error_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
 {
+    TraceSpan span("error_ssf");
+    FunctionProbe probe("error", argc, argv);
 
     std::stringstream msg;
     libdap::Str *response = new libdap::Str("info");
@@ -342,57 +1086,7 @@ void error_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseT
     else {
         libdap::Int32 *param1 = dynamic_cast<libdap::Int32*>(argv[0]);
         if (param1) {
-            libdap::dods_int32 error_type = param1->value();
-
-            switch (error_type) {
-
-            case BES_INTERNAL_ERROR: {
-                msg << "A BESInternalError was requested.";
-                BESInternalError error(msg.str(), location, 0);
-                throw error;
-            }
-                break;
-
-            case BES_INTERNAL_FATAL_ERROR: {
-                msg << "A BESInternalFatalError was requested.";
-                BESInternalFatalError error(msg.str(), location, 0);
-                throw error;
-            }
-                break;
-
-            case BES_SYNTAX_USER_ERROR: {
-                msg << "A BESSyntaxUserError was requested.";
-                BESSyntaxUserError error(msg.str(), location, 0);
-                throw error;
-            }
-                break;
-
-            case BES_FORBIDDEN_ERROR: {
-                msg << "A BESForbiddenError was requested.";
-                BESForbiddenError error(msg.str(), location, 0);
-                throw error;
-            }
-                break;
-
-            case BES_NOT_FOUND_ERROR: {
-                msg << "A BESNotFoundError was requested.";
-                BESNotFoundError error(msg.str(), location, 0);
-                throw error;
-            }
-                break;
-
-            case BES_TIMEOUT_ERROR: {
-                msg << "A BESTimeOutError was requested.";
-                BESTimeoutError error(msg.str(), location, 0);
-                throw error;
-            }
-                break;
-
-            default:
-                msg << "An unrecognized error_type parameter was received. Requested error_type: " << error_type;
-                break;
-            }
-
+            throw_bes_error(param1->value(), location, msg);
         }
         else {
             msg << "This function only accepts integer values " << "for the error type parameter.  USAGE: "
@@ -27,6 +27,8 @@
 
 #include <stdlib.h>     
 
+#include <sstream>
+
 #include <BaseType.h>
 #include <DDS.h>
 #include <ServerFunction.h>
@@ -82,6 +84,22 @@ public:
     virtual ~SleepFunc(){}
 };
 
+/*****************************************************************************************
+ * 
+ * Alloc Function (Debug Functions)
+ * 
+ * This server side function allocates the number of bytes passed
+ * in at argv[0], touches every page of it and holds it for the number
+ * of millisecs passed in at argv[1]. (nom nom nom)
+ *
+ */
+void alloc_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class AllocFunc: public libdap::ServerFunction {
+public:
+    AllocFunc();
+    virtual ~AllocFunc(){}
+};
+
 
 /*****************************************************************************************
  * 
@@ -89,6 +107,8 @@ public:
  * 
  * This server side function computes a sum until a the amount of
  * of millisecs passed in at argv[0] has transpired. (++++++)
+ * The optional argv[2] and argv[3] run the sum on several (optionally
+ * pinned) threads at once.
  *
  */
 void sum_until_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
@@ -99,6 +119,35 @@ public:
 
 };
 
+/**
+ * Measure how many terms of the sum_until sum this host computes per ms,
+ * reading the monotonic clock in batches. DebugFunctions::initialize()
+ * calls this once; sum_until and sum_n report the result.
+ *
+ * @return The calibrated rate, in terms per ms
+ */
+double calibrate_sum_until();
+
+/** @return The rate measured by calibrate_sum_until(), 0 if not yet run */
+double get_sum_until_calibration();
+
+
+/*****************************************************************************************
+ * 
+ * SumN Function (Debug Functions)
+ * 
+ * This server side function computes exactly the number of terms of
+ * the sum_until sum passed in at argv[0] and reports the elapsed time.
+ * (+,+...+ n times)
+ *
+ */
+void sum_n_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class SumNFunc: public libdap::ServerFunction {
+public:
+    SumNFunc();
+    virtual ~SumNFunc(){}
+};
+
 
 /*****************************************************************************************
  * 
@@ -115,5 +164,21 @@ public:
     virtual ~ErrorFunc(){}
 };
 
+/**
+ * Throw the BESError whose type (BES_INTERNAL_ERROR, ...) is
+ * 'error_type'. The error's message is also written to 'msg'.
+ *
+ * @param error_type The type of error to throw
+ * @param location Where the error is said to come from
+ * @param msg If 'error_type' is not a known type, nothing is thrown and
+ * this explains why
+ */
+void throw_bes_error(libdap::dods_int32 error_type, const string &location, std::stringstream &msg);
+
+/**
+ * @return True if throw_bes_error() throws an error for 'error_type'
+ */
+bool is_bes_error_type(long long error_type);
+
 } // namespace debug
 #endif /* DEBUGFUNCTIONS_H_ */
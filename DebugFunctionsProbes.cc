@@ -0,0 +1,72 @@
+// DebugFunctionsProbes.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+
+#if HAVE_SYS_SDT_H
+// The tracer finds these through the probes' ELF notes and increments
+// them while it is attached. They must have these names (provider,
+// probe, '_semaphore') and live in the .probes section.
+extern "C" {
+unsigned short bes_debug_function__entry_semaphore __attribute__((section(".probes"))) = 0;
+unsigned short bes_debug_function__return_semaphore __attribute__((section(".probes"))) = 0;
+unsigned short bes_debug_function__error_semaphore __attribute__((section(".probes"))) = 0;
+}
+#endif
+
+namespace debug_function {
+
+/**
+ * The integer value of argument 'i', or 0.
+ */
+static long long probe_arg(int argc, libdap::BaseType *argv[], int i)
+{
+    long long value = 0;
+    if (i < argc && argv && argv[i] && get_integer_arg(argv[i], value)) return value;
+    return 0;
+}
+
+void FunctionProbe::enter(int argc, libdap::BaseType *argv[])
+{
+    if (DEBUG_PROBE_ENABLED(function__entry)) {
+        long long arg0 = probe_arg(argc, argv, 0);
+        long long arg1 = probe_arg(argc, argv, 1);
+        DEBUG_PROBE4(function__entry, d_name, argc, arg0, arg1);
+    }
+
+    // Time the call only if someone was listening when it began, so a
+    // tracer that attaches part way through does not see a bogus duration.
+    if (DEBUG_PROBE_ENABLED(function__return)) d_start_ns = monotonic_ns();
+}
+
+void FunctionProbe::fire_return()
+{
+    uint64_t duration_ns = monotonic_ns() - d_start_ns;
+    DEBUG_PROBE2(function__return, d_name, duration_ns);
+}
+
+} // namespace debug_function
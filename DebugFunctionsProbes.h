@@ -0,0 +1,126 @@
+// DebugFunctionsProbes.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef DEBUGFUNCTIONSPROBES_H_
+#define DEBUGFUNCTIONSPROBES_H_
+
+#include <stdint.h>
+
+#include <BaseType.h>
+
+/*
+ * USDT (user-level statically defined tracing) probes for bpftrace, perf
+ * and systemtap. Each probe is a nop instruction plus an ELF note until
+ * a tracer attaches; the semaphore the tracer then increments lets us
+ * skip working out the probe arguments while no one is listening.
+ *
+ * Provider 'bes_debug':
+ *
+ *   function__entry(name, argc, arg0, arg1)
+ *       A debug function started. arg0 and arg1 are the integer values of
+ *       its first two arguments (0 if missing or not a number).
+ *   function__return(name, duration_ns)
+ *       It returned, threw or (for abort()) is about to kill the process.
+ *   function__error(location, error_type)
+ *       error(), chaos() or error_storm() is about to throw the BESError
+ *       'error_type' (or, if that type is unknown, report it).
+ *
+ * The names are C strings, read them with str(argN) in bpftrace. See
+ * tests/bpftrace for some scripts.
+ *
+ * This file must be included after config.h. Without sys/sdt.h the
+ * probes compile to nothing.
+ */
+#if HAVE_SYS_SDT_H
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+extern "C" {
+extern unsigned short bes_debug_function__entry_semaphore;
+extern unsigned short bes_debug_function__return_semaphore;
+extern unsigned short bes_debug_function__error_semaphore;
+}
+
+#define DEBUG_PROBE_ENABLED(probe) __builtin_expect(bes_debug_##probe##_semaphore, 0)
+#define DEBUG_PROBE2(probe, a1, a2) STAP_PROBE2(bes_debug, probe, a1, a2)
+#define DEBUG_PROBE4(probe, a1, a2, a3, a4) STAP_PROBE4(bes_debug, probe, a1, a2, a3, a4)
+
+#else
+
+#define DEBUG_PROBE_ENABLED(probe) 0
+#define DEBUG_PROBE2(probe, a1, a2) do { (void) (a1); (void) (a2); } while (0)
+#define DEBUG_PROBE4(probe, a1, a2, a3, a4) do { (void) (a1); (void) (a2); (void) (a3); (void) (a4); } while (0)
+
+#endif
+
+namespace debug_function {
+
+/**
+ * Fire function__entry when made and function__return when it goes out
+ * of scope (including by an exception). Make one at the top of each
+ * server side function.
+ */
+class FunctionProbe {
+private:
+    const char *d_name;
+    uint64_t d_start_ns;    // 0 if function__return was off at entry
+    bool d_left;
+
+    void enter(int argc, libdap::BaseType *argv[]);
+    void fire_return();
+
+    FunctionProbe(const FunctionProbe &);
+    FunctionProbe &operator=(const FunctionProbe &);
+
+public:
+    /**
+     * @param name The function's name; only the pointer is kept, so use
+     * a string literal
+     */
+    FunctionProbe(const char *name, int argc, libdap::BaseType *argv[]) :
+        d_name(name), d_start_ns(0), d_left(false)
+    {
+        if (DEBUG_PROBE_ENABLED(function__entry) || DEBUG_PROBE_ENABLED(function__return)) enter(argc, argv);
+    }
+
+    /**
+     * Fire function__return now, for a function that will not return
+     * (abort()). Later calls and the destructor do nothing.
+     */
+    void leave()
+    {
+        if (d_left) return;
+        d_left = true;
+        if (d_start_ns) fire_return();
+    }
+
+    ~FunctionProbe()
+    {
+        leave();
+    }
+};
+
+} // namespace debug_function
+#endif /* DEBUGFUNCTIONSPROBES_H_ */
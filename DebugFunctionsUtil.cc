@@ -0,0 +1,366 @@
+// DebugFunctionsUtil.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+
+#include <algorithm>
+
+#include <Byte.h>
+#include <Int16.h>
+#include <UInt16.h>
+#include <Int32.h>
+#include <UInt32.h>
+#include <Float32.h>
+#include <Float64.h>
+#include <Int8.h>
+#include <Int64.h>
+#include <UInt64.h>
+
+#include "TheBESKeys.h"
+#include "BESContextManager.h"
+#include "BESUtil.h"
+#include "BESError.h"
+
+#include "DebugFunctionsUtil.h"
+#include "FunctionStats.h"
+
+namespace debug_function {
+
+uint64_t monotonic_ns()
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (uint64_t) tv.tv_sec * 1000000000ULL + tv.tv_usec * 1000ULL;
+#endif
+}
+
+double monotonic_ms()
+{
+    return monotonic_ns() / 1.0e6;
+}
+
+bool get_integer_arg(libdap::BaseType *arg, long long &value)
+{
+    if (!arg) return false;
+
+    if (libdap::Int32 *i32 = dynamic_cast<libdap::Int32*>(arg)) {
+        value = i32->value();
+        return true;
+    }
+    if (libdap::UInt32 *ui32 = dynamic_cast<libdap::UInt32*>(arg)) {
+        value = ui32->value();
+        return true;
+    }
+    if (libdap::Int16 *i16 = dynamic_cast<libdap::Int16*>(arg)) {
+        value = i16->value();
+        return true;
+    }
+    if (libdap::UInt16 *ui16 = dynamic_cast<libdap::UInt16*>(arg)) {
+        value = ui16->value();
+        return true;
+    }
+    if (libdap::Byte *byte = dynamic_cast<libdap::Byte*>(arg)) {
+        value = byte->value();
+        return true;
+    }
+    if (libdap::Int8 *i8 = dynamic_cast<libdap::Int8*>(arg)) {
+        value = i8->value();
+        return true;
+    }
+    if (libdap::Int64 *i64 = dynamic_cast<libdap::Int64*>(arg)) {
+        value = i64->value();
+        return true;
+    }
+    if (libdap::UInt64 *ui64 = dynamic_cast<libdap::UInt64*>(arg)) {
+        if (ui64->value() > (libdap::dods_uint64) LLONG_MAX) return false;
+        value = ui64->value();
+        return true;
+    }
+
+    double d;
+    if (libdap::Float64 *f64 = dynamic_cast<libdap::Float64*>(arg))
+        d = f64->value();
+    else if (libdap::Float32 *f32 = dynamic_cast<libdap::Float32*>(arg))
+        d = f32->value();
+    else
+        return false;
+
+    // Reject values that will not fit and fractions
+    if (d < -9.2e18 || d > 9.2e18 || d != (double) (long long) d) return false;
+
+    value = (long long) d;
+    return true;
+}
+
+bool get_double_arg(libdap::BaseType *arg, double &value)
+{
+    if (libdap::Float64 *f64 = dynamic_cast<libdap::Float64*>(arg)) {
+        value = f64->value();
+        return true;
+    }
+    if (libdap::Float32 *f32 = dynamic_cast<libdap::Float32*>(arg)) {
+        value = f32->value();
+        return true;
+    }
+
+    long long integer;
+    if (!get_integer_arg(arg, integer)) return false;
+
+    value = (double) integer;
+    return true;
+}
+
+// How long before the BES timeout a Deadline expires
+#define DEADLINE_MARGIN_NS 100000000ULL
+
+Deadline Deadline::current_request()
+{
+    uint64_t now = monotonic_ns();
+    uint64_t remaining = 0;
+
+    // The BES times out a request with alarm(); if that is pending it says
+    // exactly how long we have.
+    struct itimerval timer;
+    if (getitimer(ITIMER_REAL, &timer) == 0 && (timer.it_value.tv_sec != 0 || timer.it_value.tv_usec != 0)) {
+        remaining = (uint64_t) timer.it_value.tv_sec * 1000000000ULL + (uint64_t) timer.it_value.tv_usec * 1000ULL;
+    }
+    else {
+        bool found = false;
+        std::string timeout = BESContextManager::TheManager()->get_context("bes_timeout", found);
+        long seconds = found ? atol(timeout.c_str()) : 0;
+        if (seconds > 0) remaining = (uint64_t) seconds * 1000000000ULL;
+    }
+
+    if (remaining == 0) return Deadline();
+
+    return Deadline(remaining > DEADLINE_MARGIN_NS ? now + remaining - DEADLINE_MARGIN_NS : now);
+}
+
+/**
+ * Sleep until 'deadline' on the monotonic clock.
+ */
+static void sleep_until_ns(uint64_t start, uint64_t deadline)
+{
+#if HAVE_CLOCK_NANOSLEEP && defined(CLOCK_MONOTONIC)
+    (void) start;
+    struct timespec ts;
+    ts.tv_sec = deadline / 1000000000ULL;
+    ts.tv_nsec = deadline % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, 0) == EINTR)
+        ;
+#else
+    // No absolute sleeps (e.g., OS/X); sleep for whatever time is left
+    // until the deadline has passed.
+    for (uint64_t now = start; now < deadline; now = monotonic_ns()) {
+        struct timespec ts;
+        ts.tv_sec = (deadline - now) / 1000000000ULL;
+        ts.tv_nsec = (deadline - now) % 1000000000ULL;
+        nanosleep(&ts, 0);
+    }
+#endif
+}
+
+double sleep_ms(double milliseconds)
+{
+    uint64_t start = monotonic_ns();
+    if (milliseconds <= 0) return 0.0;
+
+    sleep_until_ns(start, start + (uint64_t) (milliseconds * 1.0e6));
+
+    return (monotonic_ns() - start) / 1.0e6;
+}
+
+double sleep_ms(double milliseconds, const Deadline &deadline, bool &cut_short)
+{
+    uint64_t start = monotonic_ns();
+    cut_short = false;
+    if (milliseconds <= 0) return 0.0;
+
+    uint64_t end = start + (uint64_t) (milliseconds * 1.0e6);
+    if (deadline.is_set() && deadline.ns() < end) {
+        end = deadline.ns();
+        cut_short = true;
+    }
+
+    if (end > start) sleep_until_ns(start, end);
+
+    return (monotonic_ns() - start) / 1.0e6;
+}
+
+uint64_t RandomSource::next()
+{
+    uint64_t z = (d_state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+double RandomSource::uniform()
+{
+    return (next() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double RandomSource::normal()
+{
+    // Box-Muller; 1 - uniform() is in (0, 1] so the log is finite
+    double u1 = 1.0 - uniform();
+    double u2 = uniform();
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+uint64_t RandomSource::make_seed()
+{
+    static uint64_t calls = 0;
+    return monotonic_ns() ^ ((uint64_t) getpid() << 32) ^ (++calls * 0x9E3779B97F4A7C15ULL);
+}
+
+static uint64_t local_seeded_calls = 0;
+static uint64_t *seeded_calls = &local_seeded_calls;
+
+uint64_t RandomSource::seeded(uint64_t seed)
+{
+    return seed + __sync_fetch_and_add(seeded_calls, 1ULL);
+}
+
+bool create_shared_seed_count()
+{
+    if (seeded_calls != &local_seeded_calls) return true;
+
+    void *region = mmap(0, sizeof(uint64_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) return false;
+
+    seeded_calls = static_cast<uint64_t*>(region);
+    *seeded_calls = local_seeded_calls;
+    return true;
+}
+
+bool get_bool_key(const std::string &key, bool default_value)
+{
+    bool found = false;
+    std::string value;
+    TheBESKeys::TheKeys()->get_value(key, value, found);
+    if (!found) return default_value;
+
+    value = BESUtil::lowercase(value);
+    return value == "true" || value == "yes";
+}
+
+bool find_data_file(const std::string &path, std::string &full_path, std::string &error)
+{
+    bool found = false;
+    std::string root;
+    TheBESKeys::TheKeys()->get_value("BES.Catalog.catalog.RootDirectory", root, found);
+    if (!found || root.empty()) {
+        error = "The BES catalog root directory (BES.Catalog.catalog.RootDirectory) is not set.";
+        return false;
+    }
+
+    try {
+        BESUtil::check_path(path, root, get_bool_key("BES.Catalog.catalog.FollowSymLinks", false));
+    }
+    catch (BESError &e) {
+        error = e.get_message();
+        return false;
+    }
+
+    full_path = BESUtil::assemblePath(root, path, true);
+    return true;
+}
+
+double percentile(const std::vector<double> &values, double p)
+{
+    if (values.empty()) return 0.0;
+
+    size_t rank = (size_t) ceil(p / 100.0 * values.size());
+    return values[rank > 0 ? rank - 1 : 0];
+}
+
+void write_percentiles(std::ostream &out, std::vector<double> &values)
+{
+    std::sort(values.begin(), values.end());
+
+    out << "p50: " << percentile(values, 50) << " p90: " << percentile(values, 90) << " p99: "
+        << percentile(values, 99) << " p99.9: " << percentile(values, 99.9) << " max: "
+        << (values.empty() ? 0.0 : values.back());
+}
+
+libdap::BaseType *call_dap2_function(libdap::btp_func function, libdap::D4RValueList *args, libdap::DMR &dmr)
+{
+    unsigned int argc = args ? args->size() : 0;
+    std::vector<libdap::BaseType*> argv(argc);
+    std::vector<libdap::BaseType*> made;  // arguments made here, deleted here
+
+    try {
+        for (unsigned int i = 0; i < argc; ++i) {
+            libdap::BaseType *arg = args->get_rvalue(i)->value(dmr);
+            argv[i] = arg;
+
+            long long integer;
+            if (arg->type() == libdap::dods_int32_c || arg->type() == libdap::dods_float32_c
+                || arg->type() == libdap::dods_float64_c || !get_integer_arg(arg, integer)) continue;
+
+            if (integer >= INT_MIN && integer <= INT_MAX) {
+                libdap::Int32 *i32 = new libdap::Int32(arg->name());
+                i32->set_value((libdap::dods_int32) integer);
+                argv[i] = i32;
+            }
+            else {
+                libdap::Float64 *f64 = new libdap::Float64(arg->name());
+                f64->set_value((libdap::dods_float64) integer);
+                argv[i] = f64;
+            }
+            made.push_back(argv[i]);
+        }
+
+        libdap::DDS dds(0, dmr.name());
+        libdap::BaseType *result = 0;
+        get_timed_function(function)(argc, argc ? &argv[0] : 0, dds, &result);
+
+        for (std::vector<libdap::BaseType*>::iterator i = made.begin(), e = made.end(); i != e; ++i)
+            delete *i;
+
+        return result;
+    }
+    catch (...) {
+        for (std::vector<libdap::BaseType*>::iterator i = made.begin(), e = made.end(); i != e; ++i)
+            delete *i;
+        throw;
+    }
+}
+
+} // namespace debug_function
@@ -0,0 +1,321 @@
+// DebugFunctionsUtil.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef DEBUGFUNCTIONSUTIL_H_
+#define DEBUGFUNCTIONSUTIL_H_
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+#include <ostream>
+
+#include <BaseType.h>
+#include <DDS.h>
+#include <DMR.h>
+#include <D4RValue.h>
+#include <ServerFunction.h>
+
+namespace debug_function {
+
+/**
+ * Time on the monotonic clock, in nanoseconds. Only differences between
+ * two values are meaningful.
+ */
+uint64_t monotonic_ns();
+
+/**
+ * Time on the monotonic clock, in (fractional) milliseconds.
+ */
+double monotonic_ms();
+
+/**
+ * Read an integer valued function argument. Any of the DAP integer types
+ * is accepted, as is a floating point value with no fractional part (the
+ * constraint expression parser turns large integer literals into Float64).
+ *
+ * @param arg The argument
+ * @param value Value-result parameter; set only when true is returned
+ * @return True if 'arg' held an integer value
+ */
+bool get_integer_arg(libdap::BaseType *arg, long long &value);
+
+/**
+ * Read a numeric function argument as a double. Any of the DAP integer
+ * or floating point types is accepted.
+ *
+ * @param arg The argument
+ * @param value Value-result parameter; set only when true is returned
+ * @return True if 'arg' held a number
+ */
+bool get_double_arg(libdap::BaseType *arg, double &value);
+
+/**
+ * Sleep for 'milliseconds' on the monotonic clock. The wait is made
+ * against an absolute deadline, so signals and early wake-ups do not
+ * shorten or stretch it.
+ *
+ * @return The number of ms actually slept
+ */
+double sleep_ms(double milliseconds);
+
+/**
+ * When the BES will give up on the request being run. Long running debug
+ * functions check this as they work and stop early, returning a normal
+ * response, rather than holding the listener until the BES kills it.
+ */
+class Deadline {
+private:
+    uint64_t d_deadline_ns;     // on the monotonic clock; 0 means none
+
+public:
+    Deadline() :
+        d_deadline_ns(0)
+    {
+    }
+
+    explicit Deadline(uint64_t deadline_ns) :
+        d_deadline_ns(deadline_ns)
+    {
+    }
+
+    /**
+     * The deadline of the current request, a little before the BES
+     * timeout (the pending SIGALRM, or failing that the bes_timeout
+     * context) fires so that the response can still be sent.
+     */
+    static Deadline current_request();
+
+    /** @return True if there is a deadline */
+    bool is_set() const
+    {
+        return d_deadline_ns != 0;
+    }
+
+    /** @return The deadline on the monotonic clock, 0 if there is none */
+    uint64_t ns() const
+    {
+        return d_deadline_ns;
+    }
+
+    /** @return True if the deadline has passed */
+    bool expired() const
+    {
+        return d_deadline_ns != 0 && monotonic_ns() >= d_deadline_ns;
+    }
+};
+
+/**
+ * Sleep like sleep_ms(double), but wake up at 'deadline' if that comes
+ * first.
+ *
+ * @param cut_short Value-result parameter; true if the deadline ended
+ * the sleep
+ * @return The number of ms actually slept
+ */
+double sleep_ms(double milliseconds, const Deadline &deadline, bool &cut_short);
+
+/**
+ * A small, fast pseudo random number generator (SplitMix64). It is used
+ * instead of rand() so that each call site has its own reproducible
+ * sequence and does not disturb anyone else's.
+ */
+class RandomSource {
+private:
+    uint64_t d_state;
+
+public:
+    RandomSource(uint64_t seed) :
+        d_state(seed)
+    {
+    }
+
+    /** @return The next 64 random bits */
+    uint64_t next();
+
+    /** @return A value uniformly distributed in [0, 1) */
+    double uniform();
+
+    /** @return A value from the standard normal distribution */
+    double normal();
+
+    /** @return A seed that differs from one process and call to the next */
+    static uint64_t make_seed();
+
+    /**
+     * @return 'seed' plus the number of calls made so far with a seed.
+     * Once create_shared_seed_count() has run the count is kept across
+     * all of the beslisteners, so a seeded run of requests draws a new
+     * value for each request, whichever listener it lands on.
+     */
+    static uint64_t seeded(uint64_t seed);
+};
+
+/**
+ * Keep the count RandomSource::seeded() uses in memory shared by this
+ * process and every process it forks. Call this before the listeners
+ * fork.
+ *
+ * @return True if the shared count was made; if not each process counts
+ * its own calls
+ */
+bool create_shared_seed_count();
+
+/**
+ * Read a boolean BES key. The values 'true' and 'yes' (in any case) are
+ * true, any other value is false.
+ *
+ * @param key The key
+ * @param default_value Returned if the key is not set
+ */
+bool get_bool_key(const std::string &key, bool default_value);
+
+/**
+ * Find a file under the BES catalog root directory. The same checks the
+ * BES makes for containers (no '..', symbolic links only if allowed) are
+ * made here.
+ *
+ * @param path The file's name, relative to the catalog root
+ * @param full_path Value-result parameter; the file's absolute name
+ * @param error Value-result parameter; why the file may not be used
+ * @return True if 'full_path' may be opened
+ */
+bool find_data_file(const std::string &path, std::string &full_path, std::string &error);
+
+/**
+ * The p-th percentile (0 to 100) of 'values', by the nearest rank
+ * method. The values must be sorted; 0 is returned if there are none.
+ */
+double percentile(const std::vector<double> &values, double p);
+
+/**
+ * Sort 'values' and write their median, 90th, 99th and 99.9th
+ * percentiles and maximum as 'p50: ... max: ...'.
+ */
+void write_percentiles(std::ostream &out, std::vector<double> &values);
+
+/**
+ * Threads that each run body(&workers[i]) for one worker. start() and
+ * join() are separate so the caller can act once it knows how many
+ * threads are running (e.g. release them all at once); the destructor
+ * joins any that are left.
+ */
+class WorkerThreads {
+private:
+    std::vector<pthread_t> d_threads;
+
+    WorkerThreads(const WorkerThreads &);
+    WorkerThreads &operator=(const WorkerThreads &);
+
+public:
+    WorkerThreads()
+    {
+    }
+
+    ~WorkerThreads()
+    {
+        join();
+    }
+
+    /**
+     * Start a thread for each worker.
+     *
+     * @return The number of threads started; if a thread could not be
+     * started, the workers from that one on are not run
+     */
+    template<class W>
+    int start(void *(*body)(void *), std::vector<W> &workers)
+    {
+        d_threads.resize(workers.size());
+        int started = 0;
+        for (; started < (int) workers.size(); ++started) {
+            if (pthread_create(&d_threads[started], 0, body, &workers[started]) != 0) break;
+        }
+        d_threads.resize(started);
+        return started;
+    }
+
+    /** Wait for the threads started to finish. */
+    void join()
+    {
+        for (std::vector<pthread_t>::iterator i = d_threads.begin(), e = d_threads.end(); i != e; ++i)
+            pthread_join(*i, 0);
+        d_threads.clear();
+    }
+};
+
+/**
+ * Run body(&workers[i]) for every worker, each on a thread of its own,
+ * and wait for them all. A single worker is run on the calling thread
+ * unless 'own_threads' is true (say, because the worker changes its
+ * thread's CPU affinity).
+ *
+ * @return The number of workers that ran; if a thread could not be
+ * started, the workers from that one on did not run
+ */
+template<class W>
+int run_workers(void *(*body)(void *), std::vector<W> &workers, bool own_threads = false)
+{
+    if (workers.size() == 1 && !own_threads) {
+        body(&workers[0]);
+        return 1;
+    }
+
+    WorkerThreads threads;
+    int started = threads.start(body, workers);
+    threads.join();
+
+    return started;
+}
+
+/**
+ * Run the DAP2 form of a debug function for a DAP4 request. The
+ * arguments are evaluated and any integer among them is passed the way
+ * the DAP2 parser would pass it (an Int32 if it fits, else a Float64), so
+ * the function sees the same values in both cases. If the function has
+ * been instrumented its timing wrapper is called, so DAP4 calls are
+ * counted along with DAP2 ones.
+ *
+ * The DAP2 functions that look at the dataset have their own DAP4 form,
+ * which counts its calls with TimedCall; the rest are given an empty
+ * DDS.
+ *
+ * @return The function's result
+ */
+libdap::BaseType *call_dap2_function(libdap::btp_func function, libdap::D4RValueList *args, libdap::DMR &dmr);
+
+/**
+ * The DAP4 form of the DAP2 debug function F, for
+ * ServerFunction::setFunction(libdap::D4Function).
+ */
+template<libdap::btp_func F>
+libdap::BaseType *dap4_function(libdap::D4RValueList *args, libdap::DMR &dmr)
+{
+    return call_dap2_function(F, args, dmr);
+}
+
+} // namespace debug_function
+
+#endif /* DEBUGFUNCTIONSUTIL_H_ */
@@ -0,0 +1,204 @@
+// ErrorStormFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <exception>
+#include <vector>
+
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESError.h"
+
+#include "DebugFunctions.h"
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "ErrorStormFunc.h"
+
+namespace debug_function {
+
+#define MAX_ERROR_STORM_THREADS 1024
+
+// The most throws, over all threads, one call may make; each one's
+// latency is kept.
+#define MAX_ERROR_STORM_THROWS 10000000
+
+// Throws made between checks of the request deadline
+#define ERROR_STORM_DEADLINE_THROWS 1024
+
+/**
+ * State shared between error_storm() and one of its threads.
+ */
+struct ErrorStormWorker {
+    libdap::dods_int32 error_type;
+    long long count;                // throws to make
+    Deadline deadline;
+    std::vector<double> latencies;  // us, one per throw made
+    bool cut_short;                 // true if the deadline stopped the throws
+    bool failed;                    // true if the thread ran out of memory
+};
+
+static void *error_storm_worker(void *arg)
+{
+    ErrorStormWorker *worker = static_cast<ErrorStormWorker*>(arg);
+
+    // An exception must not leave the thread (std::terminate() would
+    // take the beslistener with it)
+    try {
+        worker->latencies.reserve(worker->count);
+        for (long long i = 0; i < worker->count; ++i) {
+            if (i % ERROR_STORM_DEADLINE_THROWS == 0 && worker->deadline.expired()) {
+                worker->cut_short = true;
+                break;
+            }
+
+            // Build the message and throw just as error() does, so the
+            // cost is that of a real error
+            uint64_t start = monotonic_ns();
+            try {
+                std::stringstream msg;
+                throw_bes_error(worker->error_type, "error_storm_ssf", msg);
+            }
+            catch (BESError &) {
+            }
+            worker->latencies.push_back((monotonic_ns() - start) / 1.0e3);
+        }
+    }
+    catch (std::exception &) {
+        worker->failed = true;
+    }
+
+    return 0;
+}
+
+/*****************************************************************************************
+ * 
+ * ErrorStorm Function (Debug Functions)
+ * 
+ * This server side function throws and catches a BESError over and over,
+ * optionally on several threads at once, to measure what exceptions
+ * cost. Each thread makes 'count' throws. With many threads the
+ * throws/sec shows how well the C++ runtime's unwinder scales (it takes
+ * locks to find the unwind tables of each frame). The latency of each
+ * throw, from construction of the error to its catch, is also
+ * reported.
+ *
+ * The error types are those of error().
+ *
+ */
+string error_storm_usage = "error_storm(<error_type>, <count> [,<nthreads>]) Throw and catch the BESError selected by <error_type> (as for error()) <count> times on each of <nthreads> threads and report the throws/sec and per-throw latency.";
+ErrorStormFunc::ErrorStormFunc()
+{
+    setName("error_storm");
+    setDescriptionString((string) "This function throws and catches many BESErrors and reports what they cost.");
+    setUsageString(error_storm_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/error_storm");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::error_storm_ssf);
+    setFunction(dap4_function<debug_function::error_storm_ssf>);
+    setVersion("1.0");
+}
+
+void error_storm_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("error_storm", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 2 || argc > 3) {
+        msg << "Missing error type or count!  USAGE: " << error_storm_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    long long error_type, count, nthreads = 1;
+    if (!get_integer_arg(argv[0], error_type) || !get_integer_arg(argv[1], count) || count < 1) {
+        msg << "The error type and count must be integers and the count at least 1.  USAGE: " << error_storm_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (argc == 3 && (!get_integer_arg(argv[2], nthreads) || nthreads < 1 || nthreads > MAX_ERROR_STORM_THREADS)) {
+        msg << "The number of threads must be an integer between 1 and " << MAX_ERROR_STORM_THREADS << ".  USAGE: "
+            << error_storm_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (count > MAX_ERROR_STORM_THROWS / nthreads) {
+        msg << "At most " << MAX_ERROR_STORM_THROWS << " throws may be made in all.  USAGE: " << error_storm_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    // Make sure the type names an error, as a whole (it is narrowed to
+    // a dods_int32 below), before starting the storm
+    if (!is_bes_error_type(error_type)) {
+        msg << "Unknown error type " << error_type << ".  USAGE: " << error_storm_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    Deadline deadline = Deadline::current_request();
+    std::vector<ErrorStormWorker> workers(nthreads);
+    for (int i = 0; i < nthreads; ++i) {
+        workers[i].error_type = error_type;
+        workers[i].count = count;
+        workers[i].deadline = deadline;
+        workers[i].cut_short = false;
+        workers[i].failed = false;
+    }
+
+    uint64_t start = monotonic_ns();
+    int started = run_workers(error_storm_worker, workers);
+    double elapsed = (monotonic_ns() - start) / 1.0e6;
+
+    std::vector<double> latencies;
+    bool cut_short = false;
+    int failed = 0;
+    for (int i = 0; i < started; ++i) {
+        latencies.insert(latencies.end(), workers[i].latencies.begin(), workers[i].latencies.end());
+        if (workers[i].cut_short) cut_short = true;
+        if (workers[i].failed) ++failed;
+    }
+
+    BESDEBUG("DebugFunctions", "error_storm_ssf() - " << latencies.size() << " throws in " << elapsed << " ms" << std::endl);
+
+    msg << "Threw and caught " << latencies.size() << " errors of type " << error_type << " on " << started
+        << " threads in " << elapsed << " ms: " << (elapsed > 0 ? latencies.size() / (elapsed / 1.0e3) : 0.0)
+        << " throws/s.";
+    if (started < nthreads) msg << " (" << nthreads - started << " threads could not be started.)";
+    if (failed) msg << " (" << failed << " threads ran out of memory.)";
+    msg << " Per-throw latency (us) ";
+    write_percentiles(msg, latencies);
+    msg << ".";
+    if (cut_short) msg << " Cut short by the BES timeout.";
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
@@ -0,0 +1,50 @@
+// ErrorStormFunc.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+#ifndef ERRORSTORMFUNC_H_
+#define ERRORSTORMFUNC_H_
+
+#include <BaseType.h>
+#include <DDS.h>
+#include <ServerFunction.h>
+
+namespace debug_function {
+
+/*****************************************************************************************
+ * 
+ * ErrorStorm Function (Debug Functions)
+ * 
+ * This server side function throws and catches the BESError selected by
+ * argv[0], argv[1] times, on argv[2] threads, and reports how long that
+ * took. (!!!!!!!!)
+ *
+ */
+void error_storm_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class ErrorStormFunc: public libdap::ServerFunction {
+public:
+    ErrorStormFunc();
+    virtual ~ErrorStormFunc(){}
+};
+
+} // namespace debug_function
+#endif /* ERRORSTORMFUNC_H_ */
@@ -0,0 +1,295 @@
+// ForkProbeFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <fstream>
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <Str.h>
+
+#include "BESDebug.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "ForkProbeFunc.h"
+
+namespace debug_function {
+
+#define MAX_FORK_PROBE_ITERATIONS 10000
+
+// The most memory fork_probe() will allocate for the children to dirty
+#define MAX_FORK_PROBE_TOUCH (1024LL * 1024 * 1024)
+
+/**
+ * What a child measured and sent back through the pipe.
+ */
+struct ForkProbeChild {
+    double touch_ms;    // time to write one byte to every page
+    long faults;        // minor faults taken doing it
+};
+
+/**
+ * The value of 'field' (e.g. "VmRSS") in a /proc file of "Field: N kB"
+ * lines, or -1 if it is not there.
+ */
+static long long proc_kb(const char *path, const string &field)
+{
+    std::ifstream in(path);
+    string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, field.size() + 1, field + ":") == 0) return atoll(line.c_str() + field.size() + 1);
+    }
+    return -1;
+}
+
+/**
+ * Write the process's RSS, page table size and anonymous huge pages.
+ */
+static void write_memory(std::ostream &msg)
+{
+    msg << "RSS " << proc_kb("/proc/self/status", "VmRSS") << " kB, page tables "
+        << proc_kb("/proc/self/status", "VmPTE") << " kB, anonymous huge pages "
+        << proc_kb("/proc/self/smaps_rollup", "AnonHugePages") << " kB";
+}
+
+/**
+ * In the child: dirty one byte in each page of 'buf', which the parent
+ * filled before forking, so each write takes a copy-on-write fault.
+ * Only async-signal-safe calls are made here since the parent may have
+ * other threads.
+ */
+static void touch_and_exit(int fd, char *buf, long long bytes, long page_size)
+{
+    ForkProbeChild result;
+    struct rusage before, after;
+    getrusage(RUSAGE_SELF, &before);
+    uint64_t start = monotonic_ns();
+    for (long long offset = 0; offset < bytes; offset += page_size)
+        buf[offset] = 1;
+    result.touch_ms = (monotonic_ns() - start) / 1.0e6;
+    getrusage(RUSAGE_SELF, &after);
+    result.faults = after.ru_minflt - before.ru_minflt;
+
+    ssize_t written = write(fd, &result, sizeof(result));
+    _exit(written == sizeof(result) ? 0 : 1);
+}
+
+/*****************************************************************************************
+ * 
+ * ForkProbe Function (Debug Functions)
+ * 
+ * This server side function measures what forking costs the
+ * beslistener at its current size, since the BES forks a listener for
+ * each connection. It forks 'iterations' times; each child exits at
+ * once, or first writes one byte to every page of a touch_bytes buffer
+ * the parent filled beforehand, which makes it copy each page. It
+ * reports:
+ *  - the fork() latency seen by the parent
+ *  - the time from fork() to reaping the exited child, i.e. fork, exit
+ *    and the teardown of the child's address space
+ *  - with touch_bytes, the copy-on-write cost per page and the faults
+ *    the child took
+ *  - the listener's RSS, page table size and anonymous huge pages, which
+ *    fork() has to copy or share
+ *
+ * @note The touch buffer is part of the RSS reported. Transparent huge
+ * pages make fork() cheaper (fewer page table entries) but each
+ * copy-on-write fault copies 2 MB.
+ *
+ */
+string fork_probe_usage = "fork_probe(<iterations> [,<touch_bytes>]) Fork and reap this beslistener <iterations> times, with each child dirtying <touch_bytes> (default 0) of copy-on-write memory, and report the fork, exit and copy-on-write costs with the RSS and page table size.";
+ForkProbeFunc::ForkProbeFunc()
+{
+    setName("fork_probe");
+    setDescriptionString((string) "This function measures the cost of fork() and copy-on-write for the beslistener.");
+    setUsageString(fork_probe_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/fork_probe");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::fork_probe_ssf);
+    setFunction(dap4_function<debug_function::fork_probe_ssf>);
+    setVersion("1.0");
+}
+
+void fork_probe_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("fork_probe", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 1 || argc > 2) {
+        msg << "Missing iteration count!  USAGE: " << fork_probe_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    long long iterations, touch_bytes = 0;
+    if (!get_integer_arg(argv[0], iterations) || iterations < 1 || iterations > MAX_FORK_PROBE_ITERATIONS) {
+        msg << "The number of iterations must be an integer between 1 and " << MAX_FORK_PROBE_ITERATIONS
+            << ".  USAGE: " << fork_probe_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (argc == 2
+        && (!get_integer_arg(argv[1], touch_bytes) || touch_bytes < 0 || touch_bytes > MAX_FORK_PROBE_TOUCH)) {
+        msg << "The bytes to touch must be an integer between 0 and " << MAX_FORK_PROBE_TOUCH << ".  USAGE: "
+            << fork_probe_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    long page_size = sysconf(_SC_PAGESIZE);
+    char *buf = 0;
+    if (touch_bytes > 0) {
+        void *region = mmap(0, touch_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (region == MAP_FAILED) {
+            msg << "Could not allocate " << touch_bytes << " bytes: " << strerror(errno);
+            response->set_value(msg.str());
+            return;
+        }
+        buf = static_cast<char*>(region);
+        // Make every page resident so the children copy rather than
+        // map fresh zero pages
+        memset(buf, 0, touch_bytes);
+    }
+
+    Deadline deadline = Deadline::current_request();
+    bool cut_short = false;
+    string error;
+
+    std::vector<double> fork_us, reap_us, cow_us;
+    long long faults = 0;
+    for (long long i = 0; i < iterations; ++i) {
+        if (deadline.expired()) {
+            cut_short = true;
+            break;
+        }
+
+        // Each child that touches the buffer reports through a pipe of
+        // its own. The parent closes the write end once the child has it,
+        // so if the child dies before writing the read sees end of file
+        // rather than waiting forever.
+        int fds[2] = { -1, -1 };
+        if (buf && pipe(fds) != 0) {
+            error = string("Could not make a pipe: ") + strerror(errno);
+            break;
+        }
+
+        uint64_t start = monotonic_ns();
+        pid_t pid = fork();
+        if (pid == 0) {
+            if (buf) {
+                close(fds[0]);
+                touch_and_exit(fds[1], buf, touch_bytes, page_size);
+            }
+            _exit(0);
+        }
+        uint64_t forked = monotonic_ns();
+        if (buf) close(fds[1]);
+        if (pid < 0) {
+            error = string("fork() failed: ") + strerror(errno);
+            if (buf) close(fds[0]);
+            break;
+        }
+
+        int status;
+        pid_t waited;
+        do {
+            waited = waitpid(pid, &status, 0);
+        } while (waited < 0 && errno == EINTR);
+        if (waited != pid) {
+            error = string("waitpid() failed: ") + strerror(errno);
+            if (buf) close(fds[0]);
+            break;
+        }
+        uint64_t reaped = monotonic_ns();
+
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            std::stringstream reason;
+            if (WIFSIGNALED(status))
+                reason << "A child was killed by signal " << WTERMSIG(status) << ".";
+            else
+                reason << "A child exited with status " << WEXITSTATUS(status) << ".";
+            error = reason.str();
+            if (buf) close(fds[0]);
+            break;
+        }
+
+        fork_us.push_back((forked - start) / 1.0e3);
+        reap_us.push_back((reaped - start) / 1.0e3);
+
+        if (buf) {
+            ForkProbeChild result;
+            ssize_t n = read(fds[0], &result, sizeof(result));
+            close(fds[0]);
+            if (n != sizeof(result)) {
+                error = "A child did not report its copy-on-write time.";
+                break;
+            }
+            faults += result.faults;
+            if (result.faults > 0) cow_us.push_back(result.touch_ms * 1.0e3 / result.faults);
+        }
+    }
+
+    BESDEBUG("DebugFunctions", "fork_probe_ssf() - " << fork_us.size() << " forks" << std::endl);
+
+    msg << "Forked " << fork_us.size() << " times";
+    if (touch_bytes > 0) msg << ", each child dirtying " << touch_bytes << " bytes";
+    msg << ". ";
+    write_memory(msg);
+    msg << ".";
+    if (!fork_us.empty()) {
+        msg << " fork() latency (us) ";
+        write_percentiles(msg, fork_us);
+        msg << ". Fork to reap (us) ";
+        write_percentiles(msg, reap_us);
+        msg << ".";
+    }
+    if (!cow_us.empty()) {
+        msg << " Copy-on-write: " << faults / (long long) cow_us.size() << " faults per child, per fault (us) ";
+        write_percentiles(msg, cow_us);
+        msg << ".";
+    }
+    if (!error.empty()) msg << " " << error;
+    if (cut_short) msg << " Cut short by the BES timeout.";
+
+    if (buf) munmap(buf, touch_bytes);
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
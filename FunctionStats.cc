@@ -0,0 +1,521 @@
+// FunctionStats.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <exception>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+
+#include <Array.h>
+#include <Structure.h>
+#include <UInt32.h>
+#include <Float64.h>
+#include <Str.h>
+#include <ServerFunctionsList.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+#include "TheBESKeys.h"
+
+#include "FunctionStats.h"
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "Trace.h"
+
+namespace debug_function {
+
+// How many server functions can be wrapped. Each needs its own wrapper
+// function because a btp_func is a plain function pointer.
+#define MAX_INSTRUMENTED_FUNCTIONS 128
+
+// Latency histogram buckets. Bucket 0 counts calls that took less than
+// 1us, bucket i (i > 0) those that took [2^(i-1), 2^i) us; the last
+// bucket also counts everything slower.
+#define LATENCY_BUCKETS 28
+
+#define FUNCTION_NAME_SIZE 64
+
+// How many calls can be tracked as in flight, over all listeners; calls
+// beyond this are counted but cannot be cleaned up if their listener dies
+#define MAX_IN_FLIGHT_CALLS 1024
+
+// Functions whose role starts with this are the module's own
+#define DEBUG_FUNCTION_ROLE "http://services.opendap.org/dap4/server-side-function/debug/"
+
+/**
+ * What is recorded for one wrapped function. These live in memory shared
+ * by every beslistener forked after the module was loaded and are only
+ * updated with atomic operations, so no locks are needed to combine the
+ * counts of concurrent requests.
+ */
+struct FunctionTiming {
+    char name[FUNCTION_NAME_SIZE];
+    libdap::btp_func function;      // the function that was wrapped
+    unsigned long long calls;
+    unsigned long long errors;      // calls that ended with an exception
+    unsigned long long total_ns;
+    unsigned long long max_ns;
+    long long in_flight;            // calls running now
+    long long peak_in_flight;
+    unsigned long long buckets[LATENCY_BUCKETS];
+};
+
+/**
+ * A call that is running, so that its share of 'in_flight' can be taken
+ * back if its listener dies (abort(), a signal, the BES timeout) before
+ * the call ends. A slot is free when 'pid' is 0.
+ */
+struct InFlightCall {
+    volatile int pid;
+    int function;                   // index in function_timings
+};
+
+// Used when the shared region cannot be made; the counts are then only
+// for the current process.
+static FunctionTiming local_timings[MAX_INSTRUMENTED_FUNCTIONS];
+static InFlightCall local_in_flight_calls[MAX_IN_FLIGHT_CALLS];
+
+static FunctionTiming *function_timings = local_timings;
+static InFlightCall *in_flight_calls = local_in_flight_calls;
+static bool timings_shared = false;
+
+// Only changed by initialize(), i.e., before the listeners fork
+static int num_instrumented = 0;
+
+bool create_shared_stats()
+{
+    if (timings_shared) return true;
+
+    void *region = mmap(0, sizeof(local_timings) + sizeof(local_in_flight_calls), PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        BESDEBUG("DebugFunctions", "create_shared_stats() - mmap failed: " << strerror(errno) << std::endl);
+        return false;
+    }
+
+    // mmap() returns zeroed memory; carry over anything already recorded
+    function_timings = static_cast<FunctionTiming*>(region);
+    in_flight_calls = reinterpret_cast<InFlightCall*>(function_timings + MAX_INSTRUMENTED_FUNCTIONS);
+    memcpy(function_timings, local_timings, sizeof(local_timings));
+    memcpy(in_flight_calls, local_in_flight_calls, sizeof(local_in_flight_calls));
+    timings_shared = true;
+
+    return true;
+}
+
+static inline int latency_bucket(unsigned long long ns)
+{
+    unsigned long long us = ns / 1000;
+    int bucket = 0;
+    while (us > 0 && bucket < LATENCY_BUCKETS - 1) {
+        us >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+static inline void update_max(long long *max, long long value)
+{
+    long long current = *max;
+    while (value > current && !__sync_bool_compare_and_swap(max, current, value))
+        current = *max;
+}
+
+/**
+ * Count a call of the Nth function as in flight.
+ *
+ * @return The slot that tracks the call, or -1 if all are taken
+ */
+static int record_start(int function)
+{
+    FunctionTiming &timing = function_timings[function];
+    long long in_flight = __sync_add_and_fetch(&timing.in_flight, 1LL);
+    update_max(&timing.peak_in_flight, in_flight);
+
+    int self = getpid();
+    for (int i = 0; i < MAX_IN_FLIGHT_CALLS; ++i) {
+        int slot = (self + i) % MAX_IN_FLIGHT_CALLS;
+        if (__sync_bool_compare_and_swap(&in_flight_calls[slot].pid, 0, self)) {
+            in_flight_calls[slot].function = function;
+            return slot;
+        }
+    }
+
+    return -1;
+}
+
+/**
+ * Record the end of a call record_start() counted.
+ */
+static void record_call(int function, int slot, unsigned long long ns, bool error)
+{
+    FunctionTiming &timing = function_timings[function];
+    if (slot >= 0) __sync_lock_release(&in_flight_calls[slot].pid);
+    __sync_fetch_and_sub(&timing.in_flight, 1LL);
+    __sync_fetch_and_add(&timing.calls, 1ULL);
+    if (error) __sync_fetch_and_add(&timing.errors, 1ULL);
+    __sync_fetch_and_add(&timing.total_ns, ns);
+    __sync_fetch_and_add(&timing.buckets[latency_bucket(ns)], 1ULL);
+
+    unsigned long long max = timing.max_ns;
+    while (ns > max && !__sync_bool_compare_and_swap(&timing.max_ns, max, ns))
+        max = timing.max_ns;
+}
+
+/**
+ * The wrapper installed in place of the Nth instrumented function.
+ */
+template<int N>
+static void timed_btp_func(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp)
+{
+    FunctionTiming &timing = function_timings[N];
+    TraceSpan span(timing.name);
+    int slot = record_start(N);
+    uint64_t start = monotonic_ns();
+    try {
+        timing.function(argc, argv, dds, btpp);
+    }
+    catch (...) {
+        record_call(N, slot, monotonic_ns() - start, true);
+        throw;
+    }
+    record_call(N, slot, monotonic_ns() - start, false);
+}
+
+/**
+ * Take the calls of listeners that died while running them out of the
+ * in flight counts.
+ */
+static void reap_dead_calls()
+{
+    for (int slot = 0; slot < MAX_IN_FLIGHT_CALLS; ++slot) {
+        int pid = in_flight_calls[slot].pid;
+        if (pid == 0 || kill(pid, 0) == 0 || errno != ESRCH) continue;
+
+        int function = in_flight_calls[slot].function;
+        if (__sync_bool_compare_and_swap(&in_flight_calls[slot].pid, pid, 0)) {
+            __sync_fetch_and_sub(&function_timings[function].in_flight, 1LL);
+            BESDEBUG("DebugFunctions", "reap_dead_calls() - process " << pid << " died in a call of "
+                << function_timings[function].name << std::endl);
+        }
+    }
+}
+
+/**
+ * Fill 'wrappers' with timed_btp_func<0> ... timed_btp_func<N-1>.
+ */
+template<int N>
+struct WrapperTable {
+    static void fill(libdap::btp_func *wrappers)
+    {
+        wrappers[N - 1] = timed_btp_func<N - 1>;
+        WrapperTable<N - 1>::fill(wrappers);
+    }
+};
+
+template<>
+struct WrapperTable<0> {
+    static void fill(libdap::btp_func *)
+    {
+    }
+};
+
+static libdap::btp_func wrappers[MAX_INSTRUMENTED_FUNCTIONS];
+
+int instrument_server_functions(bool all_functions)
+{
+    if (!wrappers[0]) WrapperTable<MAX_INSTRUMENTED_FUNCTIONS>::fill(wrappers);
+
+    libdap::ServerFunctionsList *functions = libdap::ServerFunctionsList::TheList();
+    int wrapped = 0;
+    for (std::multimap<string, libdap::ServerFunction *>::iterator it = functions->begin(); it != functions->end(); ++it) {
+        libdap::ServerFunction *function = functions->getFunction(it);
+        libdap::btp_func btp = function->get_btp_func();
+        if (!btp) continue;
+
+        if (!all_functions && function->getRole().find(DEBUG_FUNCTION_ROLE) != 0) continue;
+
+        // Don't wrap a wrapper
+        bool is_wrapper = false;
+        for (int i = 0; i < num_instrumented && !is_wrapper; ++i)
+            is_wrapper = (btp == wrappers[i]);
+        if (is_wrapper) continue;
+
+        if (num_instrumented == MAX_INSTRUMENTED_FUNCTIONS) {
+            BESDEBUG("DebugFunctions", "instrument_server_functions() - no room to instrument " << it->first << std::endl);
+            continue;
+        }
+
+        FunctionTiming &timing = function_timings[num_instrumented];
+        memset(&timing, 0, sizeof(timing));
+        strncpy(timing.name, it->first.c_str(), FUNCTION_NAME_SIZE - 1);
+        timing.function = btp;
+
+        function->setFunction(wrappers[num_instrumented]);
+        ++num_instrumented;
+        ++wrapped;
+
+        BESDEBUG("DebugFunctions", "instrument_server_functions() - instrumented " << it->first << std::endl);
+    }
+
+    return wrapped;
+}
+
+libdap::btp_func get_timed_function(libdap::btp_func function)
+{
+    for (int i = 0; i < num_instrumented; ++i)
+        if (function_timings[i].function == function) return wrappers[i];
+
+    return function;
+}
+
+TimedCall::TimedCall(libdap::btp_func counted_as) :
+    d_index(-1), d_slot(-1), d_start_ns(0)
+{
+    for (int i = 0; i < num_instrumented && d_index < 0; ++i)
+        if (function_timings[i].function == counted_as) d_index = i;
+    if (d_index < 0) return;
+
+    trace_begin(function_timings[d_index].name, 0);
+    d_slot = record_start(d_index);
+    d_start_ns = monotonic_ns();
+}
+
+TimedCall::~TimedCall()
+{
+    if (d_index < 0) return;
+
+    record_call(d_index, d_slot, monotonic_ns() - d_start_ns, std::uncaught_exception());
+    trace_end(function_timings[d_index].name);
+}
+
+/*****************************************************************************************
+ * 
+ * FunctionStats Function (Debug Functions)
+ * 
+ * This server side function returns what the timing wrappers installed
+ * by instrument_server_functions() have recorded: for each wrapped
+ * function the number of calls and errors, the total, mean and maximum
+ * latency, the current and peak concurrency and a latency histogram.
+ * When the shared stats region exists these are totals for all of the
+ * beslisteners. Calls whose listener died before they ended (abort(),
+ * a signal) are taken out of the in-flight counts when these are read.
+ *
+ */
+string function_stats_usage = "function_stats() Return call counts and latency histograms for the debug functions and the instrumented server functions (set " DEBUG_FUNCTIONS_INSTRUMENT_KEY "=true to instrument all of them).";
+FunctionStatsFunc::FunctionStatsFunc()
+{
+    setName("function_stats");
+    setDescriptionString((string) "This function returns the call counts and latencies of the server functions.");
+    setUsageString(function_stats_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/function_stats");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::function_stats_ssf);
+    setFunction(dap4_function<debug_function::function_stats_ssf>);
+    setVersion("1.0");
+}
+
+static libdap::UInt32 *make_count(const string &name, unsigned long long value)
+{
+    libdap::UInt32 *count = new libdap::UInt32(name);
+    count->set_value((libdap::dods_uint32) value);
+    count->set_read_p(true);
+    return count;
+}
+
+static libdap::Float64 *make_ms(const string &name, double value)
+{
+    libdap::Float64 *ms = new libdap::Float64(name);
+    ms->set_value(value);
+    ms->set_read_p(true);
+    return ms;
+}
+
+/**
+ * Build the Structure that describes one wrapped function.
+ */
+static libdap::Structure *make_function_stats(const FunctionTiming &timing)
+{
+    libdap::Structure *stats = new libdap::Structure(timing.name);
+
+    stats->add_var_nocopy(make_count("calls", timing.calls));
+    stats->add_var_nocopy(make_count("errors", timing.errors));
+    stats->add_var_nocopy(make_ms("total_ms", timing.total_ns / 1.0e6));
+    stats->add_var_nocopy(make_ms("mean_ms", timing.calls ? timing.total_ns / 1.0e6 / timing.calls : 0.0));
+    stats->add_var_nocopy(make_ms("max_ms", timing.max_ns / 1.0e6));
+    stats->add_var_nocopy(make_count("in_flight", timing.in_flight));
+    stats->add_var_nocopy(make_count("peak_in_flight", timing.peak_in_flight));
+
+    vector<libdap::dods_uint32> counts(LATENCY_BUCKETS);
+    for (int i = 0; i < LATENCY_BUCKETS; ++i)
+        counts[i] = (libdap::dods_uint32) timing.buckets[i];
+
+    libdap::Array *histogram = new libdap::Array("latency_histogram", 0);
+    histogram->add_var_nocopy(new libdap::UInt32("latency_histogram"));
+    histogram->append_dim(LATENCY_BUCKETS, "log2_us");
+    histogram->set_value(&counts[0], LATENCY_BUCKETS);
+    histogram->set_read_p(true);
+    stats->add_var_nocopy(histogram);
+
+    stats->set_read_p(true);
+    return stats;
+}
+
+void function_stats_ssf(int argc, libdap::BaseType *[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("function_stats", argc, 0);
+
+    std::stringstream msg;
+
+    if (argc != 0) {
+        msg << "This function takes no arguments.  USAGE: " << function_stats_usage;
+    }
+    else if (num_instrumented == 0) {
+        msg << "No server functions are instrumented.  USAGE: " << function_stats_usage;
+    }
+
+    if (!msg.str().empty()) {
+        libdap::Str *response = new libdap::Str("info");
+        response->set_value(msg.str());
+        *btpp = response;
+        return;
+    }
+
+    reap_dead_calls();
+
+    libdap::Structure *response = new libdap::Structure("function_stats");
+    for (int i = 0; i < num_instrumented; ++i)
+        response->add_var_nocopy(make_function_stats(function_timings[i]));
+    response->set_read_p(true);
+
+    *btpp = response;
+    return;
+}
+
+/*****************************************************************************************
+ * 
+ * StatsDump Function (Debug Functions)
+ * 
+ * This server side function returns the same data as function_stats()
+ * as text in the Prometheus exposition format, so a load test (or a
+ * scraper) can read the fleet-wide totals with one request.
+ *
+ */
+string stats_dump_usage = "stats_dump() Return the call counts, concurrency and latency histograms of the timed server functions, summed over all beslisteners, as Prometheus text.";
+StatsDumpFunc::StatsDumpFunc()
+{
+    setName("stats_dump");
+    setDescriptionString((string) "This function returns the server function statistics in the Prometheus text format.");
+    setUsageString(stats_dump_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/stats_dump");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::stats_dump_ssf);
+    setFunction(dap4_function<debug_function::stats_dump_ssf>);
+    setVersion("1.0");
+}
+
+/**
+ * Write one metric family: the HELP and TYPE lines and a sample for each
+ * function.
+ */
+static void write_family(std::ostream &out, const string &name, const string &type, const string &help,
+    unsigned long long FunctionTiming::*field, double scale = 1.0)
+{
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+    for (int i = 0; i < num_instrumented; ++i) {
+        const FunctionTiming &timing = function_timings[i];
+        out << name << "{function=\"" << timing.name << "\"} " << timing.*field * scale << "\n";
+    }
+}
+
+static void write_family(std::ostream &out, const string &name, const string &type, const string &help,
+    long long FunctionTiming::*field)
+{
+    out << "# HELP " << name << " " << help << "\n";
+    out << "# TYPE " << name << " " << type << "\n";
+    for (int i = 0; i < num_instrumented; ++i) {
+        const FunctionTiming &timing = function_timings[i];
+        out << name << "{function=\"" << timing.name << "\"} " << timing.*field << "\n";
+    }
+}
+
+void stats_dump_ssf(int argc, libdap::BaseType *[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("stats_dump", argc, 0);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("stats");
+    *btpp = response;
+
+    if (argc != 0) {
+        msg << "This function takes no arguments.  USAGE: " << stats_dump_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    reap_dead_calls();
+
+    msg << "# Server function statistics for "
+        << (timings_shared ? "all beslisteners" : "this beslistener only (no shared memory)") << "\n";
+
+    write_family(msg, "bes_function_calls_total", "counter", "Server function invocations.", &FunctionTiming::calls);
+    write_family(msg, "bes_function_errors_total", "counter", "Server function invocations that threw an exception.",
+        &FunctionTiming::errors);
+    write_family(msg, "bes_function_in_flight", "gauge", "Server function invocations running now.",
+        &FunctionTiming::in_flight);
+    write_family(msg, "bes_function_peak_in_flight", "gauge", "Most server function invocations running at once.",
+        &FunctionTiming::peak_in_flight);
+    write_family(msg, "bes_function_max_latency_seconds", "gauge", "Longest server function invocation.",
+        &FunctionTiming::max_ns, 1.0e-9);
+
+    const string name = "bes_function_latency_seconds";
+    msg << "# HELP " << name << " Server function latency.\n";
+    msg << "# TYPE " << name << " histogram\n";
+    for (int i = 0; i < num_instrumented; ++i) {
+        const FunctionTiming &timing = function_timings[i];
+        unsigned long long cumulative = 0;
+        for (int bucket = 0; bucket < LATENCY_BUCKETS - 1; ++bucket) {
+            cumulative += timing.buckets[bucket];
+            // Bucket 'bucket' holds calls shorter than 2^bucket us
+            msg << name << "_bucket{function=\"" << timing.name << "\",le=\"" << (1ULL << bucket) * 1.0e-6 << "\"} "
+                << cumulative << "\n";
+        }
+        cumulative += timing.buckets[LATENCY_BUCKETS - 1];
+        msg << name << "_bucket{function=\"" << timing.name << "\",le=\"+Inf\"} " << cumulative << "\n";
+        msg << name << "_sum{function=\"" << timing.name << "\"} " << timing.total_ns * 1.0e-9 << "\n";
+        msg << name << "_count{function=\"" << timing.name << "\"} " << timing.calls << "\n";
+    }
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
@@ -0,0 +1,123 @@
+// FunctionStats.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef FUNCTIONSTATS_H_
+#define FUNCTIONSTATS_H_
+
+#include <stdint.h>
+
+#include <BaseType.h>
+#include <DDS.h>
+#include <ServerFunction.h>
+
+namespace debug_function {
+
+// The BES key that turns on the timing of server functions.
+#define DEBUG_FUNCTIONS_INSTRUMENT_KEY "DebugFunctions.Instrument"
+
+/**
+ * Put the function statistics in memory shared by this process and every
+ * process it forks (i.e., all the beslisteners) so that the counts
+ * recorded by each request are summed across the listeners. Call this
+ * before instrument_server_functions().
+ *
+ * @return True if the shared region was made; if not the statistics
+ * only cover the current process
+ */
+bool create_shared_stats();
+
+/**
+ * Replace the DAP2 function of entries in the ServerFunctionsList with a
+ * wrapper that counts calls and records their latency and concurrency
+ * before passing the call to the original function. Only functions
+ * registered before this is called (i.e., by modules loaded before
+ * debug_functions) are wrapped.
+ *
+ * @param all_functions If true wrap every function, else only the debug
+ * functions
+ * @return The number of functions wrapped
+ */
+int instrument_server_functions(bool all_functions);
+
+/**
+ * The timing wrapper instrument_server_functions() installed for
+ * 'function', or 'function' itself if it was not wrapped. The DAP4 forms
+ * of the debug functions call through this so their calls are counted
+ * too.
+ */
+libdap::btp_func get_timed_function(libdap::btp_func function);
+
+/**
+ * Counts the call running while it exists as a call of the instrumented
+ * DAP2 function 'counted_as'. For the DAP4 forms that are not the DAP2
+ * function run through its wrapper (synth_dds, touch_vars). Does nothing
+ * if 'counted_as' was not instrumented. A call left by an exception is
+ * counted as an error.
+ */
+class TimedCall {
+private:
+    int d_index;
+    int d_slot;
+    uint64_t d_start_ns;
+
+    TimedCall(const TimedCall &);
+    TimedCall &operator=(const TimedCall &);
+
+public:
+    explicit TimedCall(libdap::btp_func counted_as);
+    ~TimedCall();
+};
+
+/*****************************************************************************************
+ * 
+ * FunctionStats Function (Debug Functions)
+ * 
+ * This server side function returns the call counts and latency
+ * histograms recorded for the instrumented server functions. (|||..)
+ *
+ */
+void function_stats_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class FunctionStatsFunc: public libdap::ServerFunction {
+public:
+    FunctionStatsFunc();
+    virtual ~FunctionStatsFunc(){}
+};
+
+/*****************************************************************************************
+ * 
+ * StatsDump Function (Debug Functions)
+ * 
+ * This server side function returns the statistics function_stats()
+ * returns, as Prometheus text. (# TYPE ...)
+ *
+ */
+void stats_dump_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class StatsDumpFunc: public libdap::ServerFunction {
+public:
+    StatsDumpFunc();
+    virtual ~StatsDumpFunc(){}
+};
+
+} // namespace debug_function
+#endif /* FUNCTIONSTATS_H_ */
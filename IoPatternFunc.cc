@@ -0,0 +1,473 @@
+// IoPatternFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+#if HAVE_LIBURING && HAVE_LIBURING_H
+#include <liburing.h>
+#endif
+
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "IoPatternFunc.h"
+
+namespace debug_function {
+
+#define MAX_IO_PATTERN_BLOCK (64 * 1024 * 1024)
+#define MAX_IO_PATTERN_QUEUE_DEPTH 256
+#define MAX_IO_PATTERN_COUNT 10000000
+
+// Blocks skipped between two reads of the strided pattern
+#define IO_PATTERN_STRIDE_BLOCKS 16
+
+// Read buffers are aligned like io_read()'s O_DIRECT buffers
+#define IO_PATTERN_ALIGNMENT 4096
+
+enum IoPattern {
+    pattern_sequential, pattern_random, pattern_strided
+};
+
+/**
+ * The reads to make and what became of them. One of these is shared by
+ * all the threads (or the io_uring loop) working on a request.
+ */
+struct IoPatternJob {
+    int fd;
+    long long block;
+    const std::vector<long long> *offsets;  // one per read
+    std::vector<double> *latencies;         // us, one per read; < 0 if not made
+    Deadline deadline;
+
+    long long next;                         // next read to start
+    long long bytes;                        // bytes read so far
+    long long errors;                       // reads that failed
+    int no_buffer;                          // threads that could not get a read buffer
+    int cut_short;                          // not 0 if the deadline stopped the reads
+    string failure;                         // why the reads stopped early, if they did
+};
+
+/**
+ * Fill 'offsets' with 'count' block aligned offsets in a file of
+ * 'nblocks' blocks. The strided pattern reads every
+ * IO_PATTERN_STRIDE_BLOCKS-th block, starting one block later on each
+ * pass over the file.
+ */
+static void make_offsets(IoPattern pattern, long long nblocks, long long block, long long count,
+    std::vector<long long> &offsets)
+{
+    RandomSource random(RandomSource::make_seed());
+
+    offsets.resize(count);
+    for (long long i = 0; i < count; ++i) {
+        long long index = 0;
+        switch (pattern) {
+        case pattern_sequential:
+            index = i % nblocks;
+            break;
+        case pattern_random:
+            index = random.next() % nblocks;
+            break;
+        case pattern_strided: {
+            long long position = i * IO_PATTERN_STRIDE_BLOCKS;
+            index = (position + position / nblocks) % nblocks;
+            break;
+        }
+        }
+        offsets[i] = index * block;
+    }
+}
+
+/**
+ * One of the threads of the fallback pool: take the next read and make
+ * it with pread() until none are left.
+ */
+static void *io_pattern_worker(void *arg)
+{
+    IoPatternJob *job = *static_cast<IoPatternJob**>(arg);
+    long long count = job->offsets->size();
+
+    void *buf = 0;
+    if (posix_memalign(&buf, IO_PATTERN_ALIGNMENT, job->block) != 0) {
+        __sync_fetch_and_add(&job->no_buffer, 1);
+        return 0;
+    }
+
+    for (;;) {
+        long long i = __sync_fetch_and_add(&job->next, 1);
+        if (i >= count) break;
+
+        if (job->deadline.expired()) {
+            __sync_lock_test_and_set(&job->cut_short, 1);
+            break;
+        }
+
+        uint64_t start = monotonic_ns();
+        ssize_t n = pread(job->fd, buf, job->block, (*job->offsets)[i]);
+        (*job->latencies)[i] = (monotonic_ns() - start) / 1.0e3;
+
+        if (n < 0)
+            __sync_fetch_and_add(&job->errors, 1);
+        else
+            __sync_fetch_and_add(&job->bytes, n);
+    }
+
+    free(buf);
+    return 0;
+}
+
+/**
+ * Make the reads on 'queue_depth' threads.
+ *
+ * @return The number of threads that could be started
+ */
+static int run_threads(IoPatternJob &job, int queue_depth)
+{
+    // Every thread works on the one job
+    std::vector<IoPatternJob*> jobs(queue_depth, &job);
+    int started = run_workers(io_pattern_worker, jobs);
+
+    if (started > 0 && job.no_buffer == started) job.failure = "Could not allocate a read buffer.";
+
+    return started;
+}
+
+#if HAVE_LIBURING && HAVE_LIBURING_H
+/**
+ * Wait for at least one read to complete and collect every read that
+ * has, returning their slots to 'free_slots'.
+ *
+ * @return 0, or the negative errno of io_uring_wait_cqe()
+ */
+static int reap_reads(struct io_uring &ring, IoPatternJob &job, const std::vector<long long> &slot_read,
+    const std::vector<uint64_t> &slot_start, std::vector<int> &free_slots, int &in_flight)
+{
+    struct io_uring_cqe *cqe;
+    int status;
+    do {
+        status = io_uring_wait_cqe(&ring, &cqe);
+    } while (status == -EINTR);
+    if (status < 0) return status;
+
+    uint64_t end = monotonic_ns();
+    do {
+        int slot = (int) (intptr_t) io_uring_cqe_get_data(cqe);
+        (*job.latencies)[slot_read[slot]] = (end - slot_start[slot]) / 1.0e3;
+        if (cqe->res < 0)
+            ++job.errors;
+        else
+            job.bytes += cqe->res;
+
+        free_slots.push_back(slot);
+        --in_flight;
+        io_uring_cqe_seen(&ring, cqe);
+    } while (io_uring_peek_cqe(&ring, &cqe) == 0);
+
+    return 0;
+}
+
+/**
+ * Make the reads with io_uring, keeping 'queue_depth' of them submitted
+ * at all times. If io_uring fails part way, job.failure says why.
+ *
+ * @return False if io_uring cannot be used (e.g., the kernel is too old)
+ */
+static bool run_uring(IoPatternJob &job, int queue_depth)
+{
+    struct io_uring ring;
+    if (io_uring_queue_init(queue_depth, &ring, 0) < 0) return false;
+
+    long long count = job.offsets->size();
+
+    // One buffer per slot; a slot holds one read in flight
+    std::vector<struct iovec> iovecs(queue_depth);
+    std::vector<long long> slot_read(queue_depth);
+    std::vector<uint64_t> slot_start(queue_depth);
+    std::vector<int> free_slots;
+    for (int slot = 0; slot < queue_depth; ++slot) {
+        void *buf = 0;
+        if (posix_memalign(&buf, IO_PATTERN_ALIGNMENT, job.block) != 0) break;
+        iovecs[slot].iov_base = buf;
+        iovecs[slot].iov_len = job.block;
+        free_slots.push_back(slot);
+    }
+    int nslots = free_slots.size();
+    if (nslots == 0) {
+        io_uring_queue_exit(&ring);
+        job.failure = "Could not allocate a read buffer.";
+        return true;
+    }
+
+    int pending = 0;        // prepared but not yet submitted
+    int in_flight = 0;      // submitted and not yet complete
+    while (true) {
+        while (!free_slots.empty() && job.next < count && !job.cut_short) {
+            if (job.deadline.expired()) {
+                job.cut_short = 1;
+                break;
+            }
+
+            struct io_uring_sqe *sqe = io_uring_get_sqe(&ring);
+            if (!sqe) break;
+
+            int slot = free_slots.back();
+            free_slots.pop_back();
+            io_uring_prep_readv(sqe, job.fd, &iovecs[slot], 1, (*job.offsets)[job.next]);
+            io_uring_sqe_set_data(sqe, (void *) (intptr_t) slot);
+            slot_read[slot] = job.next++;
+            slot_start[slot] = monotonic_ns();
+            ++pending;
+        }
+
+        if (pending == 0 && in_flight == 0) break;
+
+        if (pending > 0) {
+            int submitted = io_uring_submit(&ring);
+            if (submitted < 0) {
+                job.failure = string("io_uring_submit() failed: ") + strerror(-submitted);
+                break;
+            }
+            if (submitted == 0 && in_flight == 0) {
+                job.failure = "io_uring_submit() did not submit any reads.";
+                break;
+            }
+            pending -= submitted;
+            in_flight += submitted;
+        }
+
+        int status = reap_reads(ring, job, slot_read, slot_start, free_slots, in_flight);
+        if (status < 0) {
+            job.failure = string("io_uring_wait_cqe() failed: ") + strerror(-status);
+            break;
+        }
+    }
+
+    // The kernel writes into the buffers of the reads in flight until
+    // they complete, so wait for them before the buffers are freed.
+    while (in_flight > 0 && reap_reads(ring, job, slot_read, slot_start, free_slots, in_flight) == 0)
+        ;
+
+    io_uring_queue_exit(&ring);
+
+    if (in_flight == 0) {
+        // Reads prepared but never submitted are dropped with the ring
+        for (int slot = 0; slot < nslots; ++slot)
+            free(iovecs[slot].iov_base);
+    }
+    else {
+        // Leak the buffers that may still be written rather than risk it
+        BESDEBUG("DebugFunctions", "io_pattern_ssf() - leaving " << nslots - free_slots.size() << " read buffers allocated, " << in_flight << " reads did not complete" << std::endl);
+        for (std::vector<int>::iterator i = free_slots.begin(), e = free_slots.end(); i != e; ++i)
+            free(iovecs[*i].iov_base);
+    }
+
+    return true;
+}
+#endif
+
+/*****************************************************************************************
+ * 
+ * IoPattern Function (Debug Functions)
+ * 
+ * This server side function reads blocks of a file under the BES
+ * catalog root in the order a data handler might: one after another
+ * (sequential), scattered at random (random) or every 16th block
+ * (strided), the way chunked netCDF and HDF5 data are often read. Up to
+ * queue_depth reads are in flight at once, using io_uring when this
+ * module was built with liburing and the kernel supports it, and a pool
+ * of queue_depth threads otherwise. The IOPS, throughput and the
+ * distribution of the read latencies are reported.
+ *
+ * @note The reads go through the page cache; use drop_cache() first to
+ * measure the storage rather than memory.
+ *
+ */
+string io_pattern_usage = "io_pattern(<path>, <block>, \"sequential\"|\"random\"|\"strided\", <queue_depth>, <count>) Make <count> reads of <block> bytes from the file <path> under the BES data root in the given pattern, keeping <queue_depth> reads in flight, and report the IOPS and latency percentiles.";
+IoPatternFunc::IoPatternFunc()
+{
+    setName("io_pattern");
+    setDescriptionString((string) "This function reads a file in a sequential, random or strided pattern and reports the IOPS and latencies.");
+    setUsageString(io_pattern_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/io_pattern");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::io_pattern_ssf);
+    setFunction(dap4_function<debug_function::io_pattern_ssf>);
+    setVersion("1.0");
+}
+
+void io_pattern_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("io_pattern", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc != 5) {
+        msg << "Wrong number of parameters!  USAGE: " << io_pattern_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    libdap::Str *path = dynamic_cast<libdap::Str*>(argv[0]);
+    libdap::Str *pattern_param = dynamic_cast<libdap::Str*>(argv[2]);
+    if (!path || !pattern_param) {
+        msg << "The path and pattern must be strings.  USAGE: " << io_pattern_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    IoPattern pattern;
+    string pattern_name = BESUtil::lowercase(pattern_param->value());
+    if (pattern_name == "sequential")
+        pattern = pattern_sequential;
+    else if (pattern_name == "random")
+        pattern = pattern_random;
+    else if (pattern_name == "strided")
+        pattern = pattern_strided;
+    else {
+        msg << "Unknown pattern.  USAGE: " << io_pattern_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    long long block, queue_depth, count;
+    if (!get_integer_arg(argv[1], block) || block < 1 || block > MAX_IO_PATTERN_BLOCK) {
+        msg << "The block size must be an integer between 1 and " << MAX_IO_PATTERN_BLOCK << ".  USAGE: "
+            << io_pattern_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (!get_integer_arg(argv[3], queue_depth) || queue_depth < 1 || queue_depth > MAX_IO_PATTERN_QUEUE_DEPTH) {
+        msg << "The queue depth must be an integer between 1 and " << MAX_IO_PATTERN_QUEUE_DEPTH << ".  USAGE: "
+            << io_pattern_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (!get_integer_arg(argv[4], count) || count < 1 || count > MAX_IO_PATTERN_COUNT) {
+        msg << "The count must be an integer between 1 and " << MAX_IO_PATTERN_COUNT << ".  USAGE: "
+            << io_pattern_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    string full_path, error;
+    if (!find_data_file(path->value(), full_path, error)) {
+        msg << "Cannot read " << path->value() << ": " << error;
+        response->set_value(msg.str());
+        return;
+    }
+
+    int fd = open(full_path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        msg << "Could not open " << path->value() << ": " << strerror(errno);
+        if (fd >= 0) close(fd);
+        response->set_value(msg.str());
+        return;
+    }
+
+    // Only whole blocks are read, but a file shorter than one block is
+    // read from its start.
+    long long nblocks = st.st_size / block;
+    if (nblocks == 0) nblocks = 1;
+
+    std::vector<long long> offsets;
+    make_offsets(pattern, nblocks, block, count, offsets);
+    std::vector<double> latencies(count, -1.0);
+
+    IoPatternJob job;
+    job.fd = fd;
+    job.block = block;
+    job.offsets = &offsets;
+    job.latencies = &latencies;
+    job.deadline = Deadline::current_request();
+    job.next = 0;
+    job.bytes = 0;
+    job.errors = 0;
+    job.no_buffer = 0;
+    job.cut_short = 0;
+
+    string engine = "threads";
+    int threads = 0;
+    uint64_t start = monotonic_ns();
+#if HAVE_LIBURING && HAVE_LIBURING_H
+    if (run_uring(job, queue_depth))
+        engine = "io_uring";
+    else
+#endif
+        threads = run_threads(job, queue_depth);
+    double elapsed = (monotonic_ns() - start) / 1.0e6;
+
+    close(fd);
+
+    // Keep only the reads that were made
+    std::vector<double> made;
+    made.reserve(count);
+    for (std::vector<double>::iterator i = latencies.begin(), e = latencies.end(); i != e; ++i)
+        if (*i >= 0) made.push_back(*i);
+
+    if (made.empty() && !job.failure.empty()) {
+        msg << "Could not read " << path->value() << ": " << job.failure;
+        response->set_value(msg.str());
+        return;
+    }
+
+    BESDEBUG("DebugFunctions", "io_pattern_ssf() - " << made.size() << " reads with " << engine << " in " << elapsed << " ms" << std::endl);
+
+    msg << "Made " << made.size() << " " << pattern_name << " reads of " << block << " bytes from " << path->value()
+        << " at queue depth " << queue_depth << " with " << engine;
+    if (engine == "threads" && threads < queue_depth) msg << " (only " << threads << " threads started)";
+    if (job.no_buffer > 0) msg << " (" << job.no_buffer << " threads could not allocate a read buffer)";
+    msg << " in " << elapsed << " ms: " << (elapsed > 0 ? made.size() / (elapsed / 1.0e3) : 0.0) << " IOPS, "
+        << (elapsed > 0 ? (job.bytes / 1.0e6) / (elapsed / 1.0e3) : 0.0) << " MB/s.";
+    if (job.errors > 0) msg << " " << job.errors << " reads failed.";
+    msg << " Latency (us) ";
+    write_percentiles(msg, made);
+    msg << ".";
+    if (job.cut_short) msg << " Cut short by the BES timeout.";
+    if (!job.failure.empty()) msg << " Stopped early: " << job.failure;
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
@@ -0,0 +1,316 @@
+// IoReadFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <vector>
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "IoReadFunc.h"
+
+namespace debug_function {
+
+// Block size used when none is given
+#define IO_READ_DEFAULT_BLOCK 65536
+
+// The largest block io_read() will use
+#define MAX_IO_READ_BLOCK (64 * 1024 * 1024)
+
+// The most bytes one call may read (over and over from a short file)
+#define MAX_IO_READ_BYTES (64LL * 1024 * 1024 * 1024)
+
+// The most block latencies kept; beyond this they are sampled evenly
+#define MAX_IO_READ_LATENCIES 1000000
+
+// Buffer, offset and length alignment for O_DIRECT reads. 4096 satisfies
+// the logical block size of every device we are likely to see.
+#define IO_DIRECT_ALIGNMENT 4096
+
+enum IoReadMethod {
+    read_pread, read_mmap, read_direct
+};
+
+// Keeps the compiler from dropping the mmap() copies
+static volatile char io_read_sink;
+
+/**
+ * The descriptor, buffer and mapping of one io_read() call, released
+ * however the call ends.
+ */
+struct IoReadFile {
+    int fd;
+    void *buf;
+    char *map;
+    size_t map_size;
+
+    IoReadFile() :
+        fd(-1), buf(0), map(0), map_size(0)
+    {
+    }
+
+    ~IoReadFile()
+    {
+        if (map) munmap(map, map_size);
+        free(buf);
+        if (fd >= 0) close(fd);
+    }
+};
+
+/*****************************************************************************************
+ * 
+ * IoRead Function (Debug Functions)
+ * 
+ * This server side function reads a file under the BES catalog root
+ * one block at a time and times each block, so the cost of the three
+ * ways a handler might read data can be compared under real server
+ * load:
+ *  - pread: buffered pread() calls into one buffer
+ *  - mmap: mmap() the file with MADV_SEQUENTIAL and copy each block
+ *    out of the mapping
+ *  - direct: pread() with O_DIRECT, bypassing the page cache; the
+ *    block size must be a multiple of 4096
+ *
+ * When the file is shorter than the number of bytes asked for, the
+ * reads start over at the beginning of the file, so the small shipped
+ * test files can be used as well as large ones. If the number of bytes
+ * is 0, the file is read once.
+ *
+ */
+string io_read_usage = "io_read(<path>, <bytes> [,\"pread\"|\"mmap\"|\"direct\" [,<block_size>]]) Read <bytes> (0: the whole file) from the file <path> under the BES data root in blocks of <block_size> bytes (default 65536) and report the throughput and block latency percentiles.";
+IoReadFunc::IoReadFunc()
+{
+    setName("io_read");
+    setDescriptionString((string) "This function reads a file with pread, mmap or O_DIRECT and reports the throughput.");
+    setUsageString(io_read_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/io_read");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::io_read_ssf);
+    setFunction(dap4_function<debug_function::io_read_ssf>);
+    setVersion("1.0");
+}
+
+void io_read_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("io_read", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 2 || argc > 4) {
+        msg << "Missing path or byte count!  USAGE: " << io_read_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    libdap::Str *path = dynamic_cast<libdap::Str*>(argv[0]);
+    long long bytes;
+    if (!path || !get_integer_arg(argv[1], bytes) || bytes < 0 || bytes > MAX_IO_READ_BYTES) {
+        msg << "This function needs a path and a byte count between 0 and " << MAX_IO_READ_BYTES << ".  USAGE: "
+            << io_read_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    IoReadMethod method = read_pread;
+    string method_name = "pread";
+    if (argc >= 3) {
+        libdap::Str *method_param = dynamic_cast<libdap::Str*>(argv[2]);
+        method_name = method_param ? BESUtil::lowercase(method_param->value()) : "";
+        if (method_name == "pread")
+            method = read_pread;
+        else if (method_name == "mmap")
+            method = read_mmap;
+        else if (method_name == "direct")
+            method = read_direct;
+        else {
+            msg << "Unknown read method.  USAGE: " << io_read_usage;
+            response->set_value(msg.str());
+            return;
+        }
+    }
+
+    long long block = IO_READ_DEFAULT_BLOCK;
+    if (argc == 4 && (!get_integer_arg(argv[3], block) || block < 1 || block > MAX_IO_READ_BLOCK)) {
+        msg << "The block size must be an integer between 1 and " << MAX_IO_READ_BLOCK << ".  USAGE: "
+            << io_read_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (method == read_direct && block % IO_DIRECT_ALIGNMENT != 0) {
+        msg << "O_DIRECT reads need a block size that is a multiple of " << IO_DIRECT_ALIGNMENT << ".  USAGE: "
+            << io_read_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    string full_path, error;
+    if (!find_data_file(path->value(), full_path, error)) {
+        msg << "Cannot read " << path->value() << ": " << error;
+        response->set_value(msg.str());
+        return;
+    }
+
+    int flags = O_RDONLY;
+    if (method == read_direct) {
+#ifdef O_DIRECT
+        flags |= O_DIRECT;
+#else
+        msg << "O_DIRECT is not supported on this system.";
+        response->set_value(msg.str());
+        return;
+#endif
+    }
+
+    IoReadFile file;
+    file.fd = open(full_path.c_str(), flags);
+    struct stat st;
+    if (file.fd < 0 || fstat(file.fd, &st) != 0) {
+        msg << "Could not open " << path->value() << ": " << strerror(errno);
+        response->set_value(msg.str());
+        return;
+    }
+    int fd = file.fd;
+
+    long long size = st.st_size;
+    if (size == 0) {
+        msg << path->value() << " is empty.";
+        response->set_value(msg.str());
+        return;
+    }
+    if (bytes == 0) bytes = size;
+
+    if (posix_memalign(&file.buf, IO_DIRECT_ALIGNMENT, block) != 0) {
+        file.buf = 0;
+        msg << "Could not allocate a " << block << " byte buffer.";
+        response->set_value(msg.str());
+        return;
+    }
+    void *buf = file.buf;
+
+    char *map = 0;
+    if (method == read_mmap) {
+        void *mem = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (mem == MAP_FAILED) {
+            msg << "Could not map " << path->value() << ": " << strerror(errno);
+            response->set_value(msg.str());
+            return;
+        }
+        madvise(mem, size, MADV_SEQUENTIAL);
+        map = file.map = static_cast<char*>(mem);
+        file.map_size = size;
+    }
+
+    // Keep the latency of every block, or of every sample_every-th one
+    // when there are too many blocks to keep them all
+    long long nblocks = bytes / block + 1;
+    long long sample_every = (nblocks + MAX_IO_READ_LATENCIES - 1) / MAX_IO_READ_LATENCIES;
+    Deadline deadline = Deadline::current_request();
+    std::vector<double> latencies;  // us
+    latencies.reserve(nblocks / sample_every + 1);
+
+    long long blocks_read = 0;
+    long long done = 0;
+    long long offset = 0;
+    bool cut_short = false;
+    string read_error;
+
+    uint64_t start = monotonic_ns();
+    while (done < bytes) {
+        if (deadline.expired()) {
+            cut_short = true;
+            break;
+        }
+
+        // Start over at the beginning of a short file
+        if (offset >= size) offset = 0;
+
+        // O_DIRECT reads must be whole blocks; any excess is not counted
+        long long want = block;
+        if (method != read_direct) {
+            if (want > bytes - done) want = bytes - done;
+            if (want > size - offset) want = size - offset;
+        }
+
+        uint64_t block_start = monotonic_ns();
+        ssize_t n;
+        if (method == read_mmap) {
+            memcpy(buf, map + offset, want);
+            io_read_sink = static_cast<char*>(buf)[want - 1];
+            n = want;
+        }
+        else {
+            n = pread(fd, buf, want, offset);
+        }
+        uint64_t block_end = monotonic_ns();
+
+        if (n < 0) {
+            read_error = strerror(errno);
+            break;
+        }
+        if (n == 0) {
+            // The file shrank under us
+            size = offset;
+            if (size == 0) break;
+            continue;
+        }
+
+        if (blocks_read++ % sample_every == 0) latencies.push_back((block_end - block_start) / 1.0e3);
+        offset += n;
+        done += (n < bytes - done) ? n : bytes - done;
+    }
+    double elapsed = (monotonic_ns() - start) / 1.0e6;
+
+    BESDEBUG("DebugFunctions", "io_read_ssf() - read " << done << " bytes in " << elapsed << " ms" << std::endl);
+
+    if (!read_error.empty()) msg << "Read failed after " << done << " bytes: " << read_error << ". ";
+
+    msg << "Read " << done << " bytes of " << path->value() << " with " << method_name << " in " << blocks_read
+        << " blocks of " << block << " bytes in " << elapsed << " ms ("
+        << (elapsed > 0 ? (done / 1.0e6) / (elapsed / 1.0e3) : 0.0) << " MB/s). Block latency (us) ";
+    write_percentiles(msg, latencies);
+    if (sample_every > 1) msg << " (one block in " << sample_every << " sampled)";
+    msg << ".";
+    if (cut_short) msg << " Cut short by the BES timeout.";
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
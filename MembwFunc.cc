@@ -0,0 +1,430 @@
+// MembwFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <vector>
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "MembwFunc.h"
+
+// The SIMD variants are built with GCC/clang target attributes and picked
+// with __builtin_cpu_supports(), so the module still loads on CPUs
+// without AVX2 or AVX-512.
+#if (defined(__x86_64__) || defined(__i386__)) \
+    && (defined(__clang__) || __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define MEMBW_X86_VARIANTS 1
+#endif
+
+// GCC only vectorizes at -O2 since version 12, so vectorization is
+// turned on (or off) per function. clang ignores the optimize attribute
+// and vectorizes at -O2; its scalar loops are marked with a pragma.
+// GCC is also kept from replacing the copy loop with a call to memcpy().
+#if defined(__GNUC__) && !defined(__clang__)
+#define MEMBW_NO_VECTORIZE __attribute__((optimize("no-tree-vectorize", "no-tree-loop-distribute-patterns")))
+#define MEMBW_VECTORIZE __attribute__((optimize("tree-vectorize", "no-tree-loop-distribute-patterns")))
+#else
+#define MEMBW_NO_VECTORIZE
+#define MEMBW_VECTORIZE
+#endif
+
+#if defined(__clang__)
+#define MEMBW_SCALAR_LOOP _Pragma("clang loop vectorize(disable) interleave(disable)")
+#else
+#define MEMBW_SCALAR_LOOP
+#endif
+#define MEMBW_VECTOR_LOOP
+
+namespace debug_function {
+
+// The largest array membw() will allocate; it allocates three of them.
+#define MAX_MEMBW_BYTES (1024LL * 1024 * 1024)
+
+// Smallest array, so each thread has some work
+#define MIN_MEMBW_BYTES 4096
+
+#define MAX_MEMBW_THREADS 1024
+
+// Each kernel is run this many times and the fastest run is reported,
+// as STREAM does. The first run also faults in the arrays and is not
+// counted.
+#define MEMBW_RUNS 6
+
+// The scalar in scale and triad, as in STREAM
+#define MEMBW_SCALAR 3.0
+
+enum MembwKernel {
+    kernel_copy, kernel_scale, kernel_add, kernel_triad, kernel_count
+};
+
+static const char *membw_kernel_names[kernel_count] = { "copy", "scale", "add", "triad" };
+
+// The arrays each kernel reads or writes, for the byte counts
+static const int membw_kernel_arrays[kernel_count] = { 2, 2, 3, 3 };
+
+typedef void (*stream_func)(int kernel, double * __restrict__ a, double * __restrict__ b, double * __restrict__ c,
+    size_t n);
+
+// The four STREAM kernels. Each variant below is this same source built
+// with different code generation; LOOP goes before each loop.
+#define STREAM_KERNEL_BODY(LOOP) \
+    switch (kernel) { \
+    case kernel_copy: \
+        LOOP for (size_t i = 0; i < n; ++i) c[i] = a[i]; \
+        break; \
+    case kernel_scale: \
+        LOOP for (size_t i = 0; i < n; ++i) b[i] = MEMBW_SCALAR * c[i]; \
+        break; \
+    case kernel_add: \
+        LOOP for (size_t i = 0; i < n; ++i) c[i] = a[i] + b[i]; \
+        break; \
+    default: \
+        LOOP for (size_t i = 0; i < n; ++i) a[i] = b[i] + MEMBW_SCALAR * c[i]; \
+        break; \
+    }
+
+MEMBW_NO_VECTORIZE
+static void stream_scalar(int kernel, double * __restrict__ a, double * __restrict__ b, double * __restrict__ c,
+    size_t n)
+{
+    STREAM_KERNEL_BODY(MEMBW_SCALAR_LOOP)
+}
+
+MEMBW_VECTORIZE
+static void stream_vector(int kernel, double * __restrict__ a, double * __restrict__ b, double * __restrict__ c,
+    size_t n)
+{
+    STREAM_KERNEL_BODY(MEMBW_VECTOR_LOOP)
+}
+
+#if MEMBW_X86_VARIANTS
+MEMBW_VECTORIZE __attribute__((target("avx2")))
+static void stream_avx2(int kernel, double * __restrict__ a, double * __restrict__ b, double * __restrict__ c,
+    size_t n)
+{
+    STREAM_KERNEL_BODY(MEMBW_VECTOR_LOOP)
+}
+
+MEMBW_VECTORIZE __attribute__((target("avx512f")))
+static void stream_avx512(int kernel, double * __restrict__ a, double * __restrict__ b, double * __restrict__ c,
+    size_t n)
+{
+    STREAM_KERNEL_BODY(MEMBW_VECTOR_LOOP)
+}
+#endif
+
+/**
+ * The best SIMD variant this CPU can run and its name.
+ */
+static stream_func best_stream_variant(string &name)
+{
+#if MEMBW_X86_VARIANTS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        name = "avx512";
+        return stream_avx512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        name = "avx2";
+        return stream_avx2;
+    }
+#endif
+    // The compiler's baseline SIMD (SSE2 on x86-64, NEON on aarch64)
+    name = "vector";
+    return stream_vector;
+}
+
+/**
+ * Holds the workers back until every thread of a run has started, so
+ * thread creation is not part of the time measured.
+ */
+struct MembwGate {
+    pthread_mutex_t lock;
+    pthread_cond_t opened;
+    bool open;
+};
+
+/**
+ * One thread's slice of the arrays.
+ */
+struct MembwWorker {
+    stream_func function;
+    int kernel;
+    double *a;
+    double *b;
+    double *c;
+    size_t n;
+    MembwGate *gate;
+    uint64_t end_ns;
+};
+
+static void *membw_worker(void *arg)
+{
+    MembwWorker *worker = static_cast<MembwWorker*>(arg);
+
+    pthread_mutex_lock(&worker->gate->lock);
+    while (!worker->gate->open)
+        pthread_cond_wait(&worker->gate->opened, &worker->gate->lock);
+    pthread_mutex_unlock(&worker->gate->lock);
+
+    worker->function(worker->kernel, worker->a, worker->b, worker->c, worker->n);
+    worker->end_ns = monotonic_ns();
+    return 0;
+}
+
+/**
+ * Let the workers waiting at 'gate' go.
+ *
+ * @return The time they were let go
+ */
+static uint64_t open_gate(MembwGate &gate)
+{
+    pthread_mutex_lock(&gate.lock);
+    uint64_t start = monotonic_ns();
+    gate.open = true;
+    pthread_cond_broadcast(&gate.opened);
+    pthread_mutex_unlock(&gate.lock);
+    return start;
+}
+
+/**
+ * Run 'kernel' with 'function' over the workers' slices MEMBW_RUNS
+ * times and return the fastest run in ms, or 0 if no run was counted.
+ * The time of a run is from when all its threads are released to when
+ * the last one finishes. If not every thread can be started, 'failure'
+ * says so and no time is returned.
+ */
+static double time_kernel(stream_func function, int kernel, std::vector<MembwWorker> &workers,
+    const Deadline &deadline, bool &cut_short, string &failure)
+{
+    MembwGate gate;
+    pthread_mutex_init(&gate.lock, 0);
+    pthread_cond_init(&gate.opened, 0);
+
+    for (std::vector<MembwWorker>::iterator i = workers.begin(), e = workers.end(); i != e; ++i) {
+        i->function = function;
+        i->kernel = kernel;
+        i->gate = &gate;
+    }
+
+    double best = 0.0;
+    for (int run = 0; run < MEMBW_RUNS; ++run) {
+        if (deadline.expired()) {
+            cut_short = true;
+            break;
+        }
+
+        uint64_t start;
+        if (workers.size() == 1) {
+            gate.open = true;
+            start = monotonic_ns();
+            membw_worker(&workers[0]);
+        }
+        else {
+            gate.open = false;
+            WorkerThreads threads;
+            int started = threads.start(membw_worker, workers);
+            start = open_gate(gate);
+            threads.join();
+
+            if (started < (int) workers.size()) {
+                std::ostringstream oss;
+                oss << "Only " << started << " of " << workers.size() << " threads could be started.";
+                failure = oss.str();
+                best = 0.0;
+                break;
+            }
+        }
+
+        uint64_t end = start;
+        for (std::vector<MembwWorker>::iterator i = workers.begin(), e = workers.end(); i != e; ++i)
+            if (i->end_ns > end) end = i->end_ns;
+        double elapsed = (end - start) / 1.0e6;
+
+        if (run > 0 && (best == 0.0 || elapsed < best)) best = elapsed;
+    }
+
+    pthread_cond_destroy(&gate.opened);
+    pthread_mutex_destroy(&gate.lock);
+
+    return best;
+}
+
+static double gb_per_sec(long long bytes, double milliseconds)
+{
+    return milliseconds > 0 ? (bytes / 1.0e9) / (milliseconds / 1.0e3) : 0.0;
+}
+
+/*****************************************************************************************
+ * 
+ * Membw Function (Debug Functions)
+ * 
+ * This server side function measures memory bandwidth the way STREAM
+ * does. It allocates three arrays of doubles of 'bytes' bytes each and
+ * runs the copy (c = a), scale (b = s*c), add (c = a+b) and triad
+ * (a = b + s*c) kernels over them, split across 'nthreads' threads, and
+ * reports the GB/s of the fastest of five runs. Each kernel is run twice:
+ * once built without SIMD and once with the best SIMD the CPU supports
+ * (AVX-512 or AVX2 when the CPU has them, else the compiler's baseline
+ * vector instructions), chosen at run time. When the two are close the
+ * host is limited by memory bandwidth; when SIMD is much faster, by
+ * compute.
+ *
+ * @note Arrays much larger than the last level cache measure DRAM
+ * bandwidth; small ones measure the caches.
+ *
+ */
+string membw_usage = "membw(<bytes>, \"copy\"|\"scale\"|\"add\"|\"triad\"|\"all\" [,<nthreads>]) Run the STREAM kernel(s) over three arrays of <bytes> bytes each on <nthreads> threads (default 1) and report the GB/s with and without SIMD.";
+MembwFunc::MembwFunc()
+{
+    setName("membw");
+    setDescriptionString((string) "This function measures memory bandwidth with the STREAM kernels.");
+    setUsageString(membw_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/membw");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::membw_ssf);
+    setFunction(dap4_function<debug_function::membw_ssf>);
+    setVersion("1.0");
+}
+
+void membw_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("membw", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 2 || argc > 3) {
+        msg << "Missing array size or kernel!  USAGE: " << membw_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    long long bytes, nthreads = 1;
+    if (!get_integer_arg(argv[0], bytes) || bytes < MIN_MEMBW_BYTES || bytes > MAX_MEMBW_BYTES) {
+        msg << "The array size must be an integer between " << MIN_MEMBW_BYTES << " and " << MAX_MEMBW_BYTES
+            << ".  USAGE: " << membw_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    libdap::Str *kernel_param = dynamic_cast<libdap::Str*>(argv[1]);
+    string kernel_name = kernel_param ? BESUtil::lowercase(kernel_param->value()) : "";
+    int first_kernel = -1, last_kernel = -1;
+    if (kernel_name == "all") {
+        first_kernel = 0;
+        last_kernel = kernel_count - 1;
+    }
+    for (int k = 0; k < kernel_count; ++k)
+        if (kernel_name == membw_kernel_names[k]) first_kernel = last_kernel = k;
+    if (first_kernel < 0) {
+        msg << "Unknown kernel.  USAGE: " << membw_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    if (argc == 3 && (!get_integer_arg(argv[2], nthreads) || nthreads < 1 || nthreads > MAX_MEMBW_THREADS)) {
+        msg << "The number of threads must be an integer between 1 and " << MAX_MEMBW_THREADS << ".  USAGE: "
+            << membw_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    size_t n = bytes / sizeof(double);
+    if ((long long) n < nthreads) nthreads = n;
+
+    double *a = 0, *b = 0, *c = 0;
+    if (posix_memalign((void **) &a, 64, n * sizeof(double)) != 0
+        || posix_memalign((void **) &b, 64, n * sizeof(double)) != 0
+        || posix_memalign((void **) &c, 64, n * sizeof(double)) != 0) {
+        free(a);
+        free(b);
+        free(c);
+        msg << "Could not allocate three arrays of " << bytes << " bytes.";
+        response->set_value(msg.str());
+        return;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        a[i] = 1.0;
+        b[i] = 2.0;
+        c[i] = 0.0;
+    }
+
+    // Give each thread an equal slice of each array
+    std::vector<MembwWorker> workers(nthreads);
+    size_t slice = n / nthreads;
+    for (int t = 0; t < nthreads; ++t) {
+        size_t offset = t * slice;
+        workers[t].a = a + offset;
+        workers[t].b = b + offset;
+        workers[t].c = c + offset;
+        workers[t].n = t == nthreads - 1 ? n - offset : slice;
+    }
+
+    string simd_name;
+    stream_func simd = best_stream_variant(simd_name);
+
+    Deadline deadline = Deadline::current_request();
+    bool cut_short = false;
+    string failure;
+
+    msg << "STREAM over three arrays of " << n * sizeof(double) << " bytes on " << nthreads << " threads, best of "
+        << MEMBW_RUNS - 1 << " runs:";
+    for (int k = first_kernel; k <= last_kernel && !cut_short; ++k) {
+        long long moved = (long long) membw_kernel_arrays[k] * n * sizeof(double);
+        double scalar_ms = time_kernel(stream_scalar, k, workers, deadline, cut_short, failure);
+        double simd_ms = failure.empty() ? time_kernel(simd, k, workers, deadline, cut_short, failure) : 0.0;
+        if (!failure.empty()) break;
+
+        BESDEBUG("DebugFunctions", "membw_ssf() - " << membw_kernel_names[k] << ": scalar " << scalar_ms << " ms, "
+            << simd_name << " " << simd_ms << " ms" << std::endl);
+
+        msg << " " << membw_kernel_names[k] << ": scalar " << gb_per_sec(moved, scalar_ms) << " GB/s, " << simd_name
+            << " " << gb_per_sec(moved, simd_ms) << " GB/s.";
+    }
+    if (cut_short) msg << " Cut short by the BES timeout.";
+    if (!failure.empty()) msg << " Stopped: " << failure;
+
+    free(a);
+    free(b);
+    free(c);
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
@@ -0,0 +1,268 @@
+// RusageFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <cstdio>
+
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include <Int32.h>
+#include <UInt32.h>
+#include <Float64.h>
+#include <Str.h>
+#include <Structure.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "RusageFunc.h"
+
+namespace debug_function {
+
+/**
+ * The resource usage of this process at one moment. The values read
+ * from /proc are -1 when it is not available.
+ */
+struct UsageSnapshot {
+    double wall_ms;
+    double user_sec;
+    double sys_sec;
+    long long max_rss_kb;
+    long long rss_kb;
+    long long minor_faults;
+    long long major_faults;
+    long long voluntary_switches;
+    long long involuntary_switches;
+    long long open_fds;
+};
+
+// The snapshot taken by the last rusage("reset") in this beslistener
+static UsageSnapshot usage_baseline;
+static bool usage_baseline_set = false;
+
+static double timeval_sec(const struct timeval &tv)
+{
+    return tv.tv_sec + tv.tv_usec / 1.0e6;
+}
+
+/**
+ * The resident set size from /proc/self/statm, in kB.
+ */
+static long long current_rss_kb()
+{
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (!statm) return -1;
+
+    long long size, resident;
+    int n = fscanf(statm, "%lld %lld", &size, &resident);
+    fclose(statm);
+    if (n != 2) return -1;
+
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/**
+ * The number of open file descriptors, from /proc/self/fd.
+ */
+static long long open_fd_count()
+{
+    DIR *dir = opendir("/proc/self/fd");
+    if (!dir) return -1;
+
+    long long count = 0;
+    while (struct dirent *entry = readdir(dir))
+        if (entry->d_name[0] != '.') ++count;
+
+    closedir(dir);
+
+    // Don't count the descriptor opendir() used
+    return count - 1;
+}
+
+static UsageSnapshot take_snapshot()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    UsageSnapshot snapshot;
+    snapshot.wall_ms = monotonic_ms();
+    snapshot.user_sec = timeval_sec(usage.ru_utime);
+    snapshot.sys_sec = timeval_sec(usage.ru_stime);
+    snapshot.max_rss_kb = usage.ru_maxrss;
+    snapshot.rss_kb = current_rss_kb();
+    snapshot.minor_faults = usage.ru_minflt;
+    snapshot.major_faults = usage.ru_majflt;
+    snapshot.voluntary_switches = usage.ru_nvcsw;
+    snapshot.involuntary_switches = usage.ru_nivcsw;
+    snapshot.open_fds = open_fd_count();
+
+    return snapshot;
+}
+
+template<class T, class V>
+static void add_field(libdap::Structure *s, const string &name, V value)
+{
+    T *field = new T(name);
+    field->set_value(value);
+    field->set_read_p(true);
+    s->add_var_nocopy(field);
+}
+
+/**
+ * Make a Structure named 'name' holding 'usage'. Counters that only
+ * grow are UInt32s; the current RSS and the descriptor count may shrink
+ * between snapshots and are Int32s.
+ */
+static libdap::Structure *usage_structure(const string &name, const UsageSnapshot &usage)
+{
+    libdap::Structure *s = new libdap::Structure(name);
+    add_field<libdap::Float64>(s, "user_cpu_sec", usage.user_sec);
+    add_field<libdap::Float64>(s, "sys_cpu_sec", usage.sys_sec);
+    add_field<libdap::UInt32>(s, "max_rss_kb", (libdap::dods_uint32) usage.max_rss_kb);
+    add_field<libdap::Int32>(s, "rss_kb", (libdap::dods_int32) usage.rss_kb);
+    add_field<libdap::UInt32>(s, "minor_faults", (libdap::dods_uint32) usage.minor_faults);
+    add_field<libdap::UInt32>(s, "major_faults", (libdap::dods_uint32) usage.major_faults);
+    add_field<libdap::UInt32>(s, "voluntary_switches", (libdap::dods_uint32) usage.voluntary_switches);
+    add_field<libdap::UInt32>(s, "involuntary_switches", (libdap::dods_uint32) usage.involuntary_switches);
+    add_field<libdap::Int32>(s, "open_fds", (libdap::dods_int32) usage.open_fds);
+    s->set_read_p(true);
+    return s;
+}
+
+/**
+ * The change from 'base' to 'now'. The wall time goes in wall_ms.
+ */
+static UsageSnapshot usage_delta(const UsageSnapshot &now, const UsageSnapshot &base)
+{
+    UsageSnapshot delta;
+    delta.wall_ms = now.wall_ms - base.wall_ms;
+    delta.user_sec = now.user_sec - base.user_sec;
+    delta.sys_sec = now.sys_sec - base.sys_sec;
+    delta.max_rss_kb = now.max_rss_kb - base.max_rss_kb;
+    delta.rss_kb = now.rss_kb - base.rss_kb;
+    delta.minor_faults = now.minor_faults - base.minor_faults;
+    delta.major_faults = now.major_faults - base.major_faults;
+    delta.voluntary_switches = now.voluntary_switches - base.voluntary_switches;
+    delta.involuntary_switches = now.involuntary_switches - base.involuntary_switches;
+    delta.open_fds = now.open_fds - base.open_fds;
+    return delta;
+}
+
+/*****************************************************************************************
+ * 
+ * Rusage Function (Debug Functions)
+ * 
+ * This server side function returns a Structure named rusage with the
+ * resource usage of the beslistener that runs it: CPU time, peak and
+ * current RSS, page faults, context switches and open descriptors
+ * (getrusage() and /proc/self). The 'total' member holds the usage
+ * since the listener started; 'since_reset' holds the change since
+ * the last rusage("reset") in this listener, and the wall time that
+ * has passed. When called with "reset" the usage is returned and then
+ * becomes the new baseline, so a single request can bracket a workload:
+ *
+ *     rusage("reset"),sum_until(500),rusage()
+ *
+ * @note Each beslistener keeps its own baseline; the pid member tells
+ * which listener answered. Before the first reset the baseline is zero
+ * and since_reset.wall_ms is 0.
+ *
+ */
+string rusage_usage = "rusage([\"reset\"]) Return the CPU time, RSS, page faults, context switches and open file descriptors of this beslistener, in total and since the last reset.";
+RusageFunc::RusageFunc()
+{
+    setName("rusage");
+    setDescriptionString((string) "This function returns the resource usage of the beslistener.");
+    setUsageString(rusage_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/rusage");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::rusage_ssf);
+    setFunction(dap4_function<debug_function::rusage_ssf>);
+    setVersion("1.0");
+}
+
+void rusage_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("rusage", argc, argv);
+
+    std::stringstream msg;
+
+    bool reset = false;
+    if (argc > 1) {
+        msg << "Too many parameters!  USAGE: " << rusage_usage;
+    }
+    else if (argc == 1) {
+        libdap::Str *param = dynamic_cast<libdap::Str*>(argv[0]);
+        reset = param && BESUtil::lowercase(param->value()) == "reset";
+        if (!reset) msg << "The only parameter this function accepts is \"reset\".  USAGE: " << rusage_usage;
+    }
+
+    if (!msg.str().empty()) {
+        libdap::Str *response = new libdap::Str("info");
+        response->set_value(msg.str());
+        *btpp = response;
+        return;
+    }
+
+    UsageSnapshot now = take_snapshot();
+
+    UsageSnapshot base;
+    if (usage_baseline_set) {
+        base = usage_baseline;
+    }
+    else {
+        base = UsageSnapshot();
+        base.wall_ms = now.wall_ms;
+    }
+    UsageSnapshot delta = usage_delta(now, base);
+
+    libdap::Structure *response = new libdap::Structure("rusage");
+    add_field<libdap::Int32>(response, "pid", (libdap::dods_int32) getpid());
+    response->add_var_nocopy(usage_structure("total", now));
+
+    libdap::Structure *since_reset = usage_structure("since_reset", delta);
+    add_field<libdap::Float64>(since_reset, "wall_ms", delta.wall_ms);
+    response->add_var_nocopy(since_reset);
+    response->set_read_p(true);
+
+    if (reset) {
+        usage_baseline = now;
+        usage_baseline_set = true;
+    }
+
+    BESDEBUG("DebugFunctions", "rusage_ssf() - user " << now.user_sec << " s, sys " << now.sys_sec << " s, max RSS "
+        << now.max_rss_kb << " kB" << (reset ? ", reset" : "") << std::endl);
+
+    *btpp = response;
+    return;
+}
+
+} // namespace debug_function
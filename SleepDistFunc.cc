@@ -0,0 +1,211 @@
+// SleepDistFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <math.h>
+
+#include <Int32.h>
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "SleepDistFunc.h"
+#include "DebugFunctionsProbes.h"
+
+namespace debug_function {
+
+// No single draw sleeps longer than this (one hour); heavy tails can
+// otherwise produce absurd values.
+#define MAX_SLEEP_DIST_MS 3600000.0
+
+bool get_delay_distribution(const string &name, DelayDistribution &dist)
+{
+    string lc_name = BESUtil::lowercase(name);
+
+    if (lc_name == "constant")
+        dist = delay_constant;
+    else if (lc_name == "uniform")
+        dist = delay_uniform;
+    else if (lc_name == "exponential")
+        dist = delay_exponential;
+    else if (lc_name == "lognormal")
+        dist = delay_lognormal;
+    else if (lc_name == "pareto")
+        dist = delay_pareto;
+    else
+        return false;
+
+    return true;
+}
+
+string check_delay_parameters(DelayDistribution dist, double p1, double p2)
+{
+    switch (dist) {
+    case delay_constant:
+        if (p1 < 0) return "The delay must not be negative.";
+        break;
+    case delay_uniform:
+        if (p1 < 0 || p2 < p1) return "The uniform range must satisfy 0 <= p1 <= p2.";
+        break;
+    case delay_exponential:
+        if (p1 <= 0 || p2 < 0) return "The exponential mean must be positive and the offset not negative.";
+        break;
+    case delay_lognormal:
+        if (p1 <= 0 || p2 < 0) return "The lognormal median must be positive and sigma not negative.";
+        break;
+    case delay_pareto:
+        if (p1 <= 0 || p2 <= 0) return "The Pareto minimum and shape must be positive.";
+        break;
+    }
+
+    return "";
+}
+
+double draw_delay_ms(DelayDistribution dist, double p1, double p2, RandomSource &random)
+{
+    double ms = 0.0;
+
+    switch (dist) {
+    case delay_constant:
+        ms = p1;
+        break;
+    case delay_uniform:
+        ms = p1 + (p2 - p1) * random.uniform();
+        break;
+    case delay_exponential:
+        ms = p2 - p1 * log(1.0 - random.uniform());
+        break;
+    case delay_lognormal:
+        ms = p1 * exp(p2 * random.normal());
+        break;
+    case delay_pareto:
+        ms = p1 / pow(1.0 - random.uniform(), 1.0 / p2);
+        break;
+    }
+
+    return ms > MAX_SLEEP_DIST_MS ? MAX_SLEEP_DIST_MS : ms;
+}
+
+/*****************************************************************************************
+ * 
+ * SleepDist Function (Debug Functions)
+ * 
+ * This server side function sleeps for a time drawn from a
+ * distribution, so that the latency it adds looks like that of a real
+ * (and sometimes very slow) back end rather than a constant. It reports
+ * both the drawn and the measured sleep times.
+ *
+ * @note With a seed the n-th seeded call made to the server (counted
+ * across all of the beslisteners since the BES started) always draws
+ * the same value, so a run can be repeated; without one each call is
+ * seeded from the clock and process id.
+ *
+ */
+string sleep_dist_usage = "sleep_dist(<dist>, <p1>, <p2> [,<seed>]) Sleep for a time drawn from <dist>: \"constant\" (p1 ms), \"uniform\" (p1 to p2 ms), \"exponential\" (p2 ms plus a mean of p1 ms), \"lognormal\" (median p1 ms, sigma p2) or \"pareto\" (minimum p1 ms, shape p2).";
+SleepDistFunc::SleepDistFunc()
+{
+    setName("sleep_dist");
+    setDescriptionString((string) "This function sleeps for a time drawn from a statistical distribution.");
+    setUsageString(sleep_dist_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/sleep_dist");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::sleep_dist_ssf);
+    setFunction(dap4_function<debug_function::sleep_dist_ssf>);
+    setVersion("1.0");
+}
+
+void sleep_dist_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("sleep_dist", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc < 3 || argc > 4) {
+        msg << "Missing distribution or parameter!  USAGE: " << sleep_dist_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    DelayDistribution dist;
+    libdap::Str *dist_param = dynamic_cast<libdap::Str*>(argv[0]);
+    if (!dist_param || !get_delay_distribution(dist_param->value(), dist)) {
+        msg << "Unknown distribution.  USAGE: " << sleep_dist_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    double p1, p2;
+    if (!get_double_arg(argv[1], p1) || !get_double_arg(argv[2], p2)) {
+        msg << "This function only accepts numeric values for the distribution parameters.  USAGE: "
+            << sleep_dist_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    string problem = check_delay_parameters(dist, p1, p2);
+    if (!problem.empty()) {
+        msg << problem << "  USAGE: " << sleep_dist_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    uint64_t seed;
+    if (argc == 4) {
+        long long seed_param;
+        if (!get_integer_arg(argv[3], seed_param)) {
+            msg << "This function only accepts integer values for the seed.  USAGE: " << sleep_dist_usage;
+            response->set_value(msg.str());
+            return;
+        }
+
+        seed = RandomSource::seeded(seed_param);
+    }
+    else {
+        seed = RandomSource::make_seed();
+    }
+
+    RandomSource random(seed);
+    double drawn = draw_delay_ms(dist, p1, p2, random);
+    bool cut_short;
+    double slept = sleep_ms(drawn, Deadline::current_request(), cut_short);
+
+    BESDEBUG("DebugFunctions", "sleep_dist_ssf() - drew " << drawn << " ms, slept " << slept << " ms" << std::endl);
+
+    msg << "Drew " << drawn << " ms from " << BESUtil::lowercase(dist_param->value()) << "(" << p1 << ", " << p2
+        << "); slept for " << slept << " ms";
+    if (cut_short)
+        msg << "; cut short by the BES timeout.";
+    else
+        msg << " (overshoot " << slept - drawn << " ms).";
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
@@ -0,0 +1,87 @@
+// SleepDistFunc.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef SLEEPDISTFUNC_H_
+#define SLEEPDISTFUNC_H_
+
+#include <string>
+
+#include <BaseType.h>
+#include <DDS.h>
+#include <ServerFunction.h>
+
+#include "DebugFunctionsUtil.h"
+
+namespace debug_function {
+
+/**
+ * The distributions sleep_dist() (and chaos()) draw delays from. The
+ * meaning of the two parameters, both in milliseconds except where noted:
+ *  - constant: p1
+ *  - uniform: between p1 and p2
+ *  - exponential: p2 plus an exponentially distributed value with mean p1
+ *  - lognormal: median p1, log-space standard deviation p2 (unitless)
+ *  - pareto: minimum p1, shape p2 (unitless; <= 2 has infinite variance)
+ */
+enum DelayDistribution {
+    delay_constant, delay_uniform, delay_exponential, delay_lognormal, delay_pareto
+};
+
+/**
+ * Look up a distribution by name (case does not matter).
+ *
+ * @return True if 'name' names a distribution
+ */
+bool get_delay_distribution(const std::string &name, DelayDistribution &dist);
+
+/**
+ * Check the parameters for a distribution.
+ *
+ * @return An empty string if they are usable, else what is wrong
+ */
+std::string check_delay_parameters(DelayDistribution dist, double p1, double p2);
+
+/**
+ * Draw a delay, in milliseconds, from a distribution.
+ */
+double draw_delay_ms(DelayDistribution dist, double p1, double p2, RandomSource &random);
+
+/*****************************************************************************************
+ * 
+ * SleepDist Function (Debug Functions)
+ * 
+ * This server side function sleeps for a time drawn from the
+ * distribution named at argv[0] with the parameters at argv[1] and
+ * argv[2]. (Zzz..Zzzzzzzzzzz..Zz)
+ *
+ */
+void sleep_dist_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class SleepDistFunc: public libdap::ServerFunction {
+public:
+    SleepDistFunc();
+    virtual ~SleepDistFunc(){}
+};
+
+} // namespace debug_function
+#endif /* SLEEPDISTFUNC_H_ */
@@ -0,0 +1,274 @@
+// SynthArrayFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <limits.h>
+#include <stdint.h>
+
+#include <algorithm>
+
+#include <Array.h>
+#include <Byte.h>
+#include <Int16.h>
+#include <UInt16.h>
+#include <Int32.h>
+#include <UInt32.h>
+#include <Float32.h>
+#include <Float64.h>
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "SynthArrayFunc.h"
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+
+namespace debug_function {
+
+/*****************************************************************************************
+ * 
+ * SynthArray Function (Debug Functions)
+ * 
+ * This server side function builds an Array of the requested type and
+ * shape and fills it with synthetic data. It is meant for measuring the
+ * cost of serializing and transmitting large responses without having to
+ * stage large files.
+ *
+ */
+string synth_array_usage = "synth_array(<type>, <dim1> [,<dim2> ...] [,\"constant\"|\"ramp\"|\"random\"]) Return an Array of <type> (Byte, Int16, UInt16, Int32, UInt32, Float32 or Float64) with the given dimension sizes filled with the named pattern (default: ramp).";
+SynthArrayFunc::SynthArrayFunc()
+{
+    setName("synth_array");
+    setDescriptionString((string) "This function returns an Array of the given type and shape filled with synthetic data.");
+    setUsageString(synth_array_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/synth_array");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::synth_array_ssf);
+    setFunction(dap4_function<debug_function::synth_array_ssf>);
+    setVersion("1.0");
+}
+
+enum FillPattern {
+    fill_constant, fill_ramp, fill_random
+};
+
+/**
+ * A stateless 'random' value for element i (the SplitMix64 finalizer).
+ * Because each value depends only on its index the fill loop has no
+ * loop-carried dependency and the compiler can vectorize it, and the
+ * data are the same from one request to the next.
+ */
+static inline uint64_t mix64(uint64_t i)
+{
+    uint64_t z = i + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Random values: integer types take the low bits, floating point types
+// get a value in [0, 1).
+template<typename T> static inline T random_value(uint64_t i)
+{
+    return (T) mix64(i);
+}
+
+template<> inline libdap::dods_float32 random_value<libdap::dods_float32>(uint64_t i)
+{
+    return (libdap::dods_float32) ((mix64(i) >> 40) * (1.0 / 16777216.0));
+}
+
+template<> inline libdap::dods_float64 random_value<libdap::dods_float64>(uint64_t i)
+{
+    return (libdap::dods_float64) ((mix64(i) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+/**
+ * Fill 'buf' with 'n' values. Each case is a simple counted loop with no
+ * calls so that it vectorizes.
+ */
+template<typename T> static void fill_values(T *buf, int64_t n, FillPattern pattern)
+{
+    switch (pattern) {
+    case fill_constant:
+        std::fill(buf, buf + n, (T) 1);
+        break;
+
+    case fill_ramp:
+        for (int64_t i = 0; i < n; ++i)
+            buf[i] = (T) i;
+        break;
+
+    case fill_random:
+        for (int64_t i = 0; i < n; ++i)
+            buf[i] = random_value<T>((uint64_t) i);
+        break;
+    }
+}
+
+/**
+ * Make the (empty) Array for the named type.
+ *
+ * @return The new Array or null if 'type' is not a supported type name
+ */
+static libdap::Array *make_array(const string &type)
+{
+    const string name = "synth_array";
+    libdap::BaseType *proto = 0;
+
+    if (type == "byte")
+        proto = new libdap::Byte(name);
+    else if (type == "int16")
+        proto = new libdap::Int16(name);
+    else if (type == "uint16")
+        proto = new libdap::UInt16(name);
+    else if (type == "int32")
+        proto = new libdap::Int32(name);
+    else if (type == "uint32")
+        proto = new libdap::UInt32(name);
+    else if (type == "float32")
+        proto = new libdap::Float32(name);
+    else if (type == "float64")
+        proto = new libdap::Float64(name);
+    else
+        return 0;
+
+    libdap::Array *array = new libdap::Array(name, 0);
+    array->add_var_nocopy(proto);
+    return array;
+}
+
+/**
+ * Allocate the Array's value buffer and fill it in place; this avoids
+ * building the data in a separate buffer and then copying it.
+ */
+static void fill_array(libdap::Array *array, const string &type, int64_t n, FillPattern pattern)
+{
+    array->reserve_value_capacity(n);
+    char *buf = array->get_buf();
+
+    if (type == "byte")
+        fill_values(reinterpret_cast<libdap::dods_byte*>(buf), n, pattern);
+    else if (type == "int16")
+        fill_values(reinterpret_cast<libdap::dods_int16*>(buf), n, pattern);
+    else if (type == "uint16")
+        fill_values(reinterpret_cast<libdap::dods_uint16*>(buf), n, pattern);
+    else if (type == "int32")
+        fill_values(reinterpret_cast<libdap::dods_int32*>(buf), n, pattern);
+    else if (type == "uint32")
+        fill_values(reinterpret_cast<libdap::dods_uint32*>(buf), n, pattern);
+    else if (type == "float32")
+        fill_values(reinterpret_cast<libdap::dods_float32*>(buf), n, pattern);
+    else if (type == "float64")
+        fill_values(reinterpret_cast<libdap::dods_float64*>(buf), n, pattern);
+
+    array->set_read_p(true);
+}
+
+void synth_array_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("synth_array", argc, argv);
+
+    std::stringstream msg;
+
+    libdap::Str *type_param = argc > 0 ? dynamic_cast<libdap::Str*>(argv[0]) : 0;
+    if (argc < 2 || !type_param) {
+        libdap::Str *response = new libdap::Str("info");
+        msg << "Missing type or dimension parameter!  USAGE: " << synth_array_usage;
+        response->set_value(msg.str());
+        *btpp = response;
+        return;
+    }
+
+    string type = BESUtil::lowercase(type_param->value());
+
+    // An optional trailing string names the fill pattern
+    int ndims = argc - 1;
+    FillPattern pattern = fill_ramp;
+    if (libdap::Str *pattern_param = dynamic_cast<libdap::Str*>(argv[argc - 1])) {
+        string name = BESUtil::lowercase(pattern_param->value());
+        if (name == "constant")
+            pattern = fill_constant;
+        else if (name == "ramp")
+            pattern = fill_ramp;
+        else if (name == "random")
+            pattern = fill_random;
+        else
+            msg << "Unknown fill pattern '" << pattern_param->value() << "'.  USAGE: " << synth_array_usage;
+
+        --ndims;
+    }
+
+    vector<long long> dims;
+    long long total = 1;
+    for (int i = 1; msg.str().empty() && i <= ndims; ++i) {
+        long long size;
+        if (!get_integer_arg(argv[i], size) || size < 1) {
+            msg << "Dimension sizes must be positive integers.  USAGE: " << synth_array_usage;
+        }
+        else if (total > INT_MAX / size) {
+            msg << "The requested array has more than " << INT_MAX << " elements.";
+        }
+        else {
+            dims.push_back(size);
+            total *= size;
+        }
+    }
+
+    if (msg.str().empty() && dims.empty())
+        msg << "Missing dimension parameter!  USAGE: " << synth_array_usage;
+
+    libdap::Array *array = 0;
+    if (msg.str().empty()) {
+        array = make_array(type);
+        if (!array) msg << "Unsupported type '" << type_param->value() << "'.  USAGE: " << synth_array_usage;
+    }
+
+    if (!array) {
+        libdap::Str *response = new libdap::Str("info");
+        response->set_value(msg.str());
+        *btpp = response;
+        return;
+    }
+
+    for (vector<long long>::size_type i = 0; i < dims.size(); ++i) {
+        std::ostringstream dim_name;
+        dim_name << "dim" << i + 1;
+        array->append_dim((int) dims[i], dim_name.str());
+    }
+
+    double start_time = monotonic_ms();
+    fill_array(array, type, total, pattern);
+
+    BESDEBUG("DebugFunctions", "synth_array_ssf() - filled " << total << " " << type << " values in "
+        << monotonic_ms() - start_time << " ms" << std::endl);
+
+    *btpp = array;
+    return;
+}
+
+} // namespace debug_function
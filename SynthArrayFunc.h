@@ -0,0 +1,51 @@
+// SynthArrayFunc.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef SYNTHARRAYFUNC_H_
+#define SYNTHARRAYFUNC_H_
+
+#include <BaseType.h>
+#include <DDS.h>
+#include <ServerFunction.h>
+
+namespace debug_function {
+
+/*****************************************************************************************
+ * 
+ * SynthArray Function (Debug Functions)
+ * 
+ * This server side function returns an Array of the type named at
+ * argv[0] with the shape given by the integers that follow it, filled
+ * with constant, ramp or random values. ([0, 1, 2, ...])
+ *
+ */
+void synth_array_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class SynthArrayFunc: public libdap::ServerFunction {
+public:
+    SynthArrayFunc();
+    virtual ~SynthArrayFunc(){}
+};
+
+} // namespace debug_function
+#endif /* SYNTHARRAYFUNC_H_ */
@@ -0,0 +1,245 @@
+// SynthDdsFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+
+#include <Byte.h>
+#include <Int32.h>
+#include <Float64.h>
+#include <Str.h>
+#include <Structure.h>
+#include <AttrTable.h>
+#include <D4Attributes.h>
+
+#include "BESDebug.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "FunctionStats.h"
+#include "SynthDdsFunc.h"
+
+namespace debug_function {
+
+#define MAX_SYNTH_DDS_VARS 1000000
+#define MAX_SYNTH_DDS_DEPTH 64
+#define MAX_SYNTH_DDS_ATTRS 1000
+
+// The most attributes, over all variables, one call may make
+#define MAX_SYNTH_DDS_TOTAL_ATTRS 10000000
+
+// Variables per innermost Structure when nesting
+#define SYNTH_DDS_GROUP_VARS 16
+
+/**
+ * Make a name like 'var_12'.
+ */
+static string numbered(const string &prefix, long long n)
+{
+    std::ostringstream name;
+    name << prefix << "_" << n;
+    return name.str();
+}
+
+/**
+ * Add an attribute to 'var': to its DAP4 attributes if 'dap4' is true,
+ * else to its DAP2 AttrTable.
+ */
+static void add_attribute(libdap::BaseType *var, const string &name, libdap::D4AttributeType type,
+    const string &value, bool dap4)
+{
+    if (dap4) {
+        libdap::D4Attribute *attr = new libdap::D4Attribute(name, type);
+        attr->add_value(value);
+        var->attributes()->add_attribute_nocopy(attr);
+    }
+    else {
+        var->get_attr_table().append_attr(name,
+            type == libdap::attr_int32_c ? "Int32" : (type == libdap::attr_float64_c ? "Float64" : "String"), value);
+    }
+}
+
+/**
+ * Make the i-th variable: a Byte, Int32, Float64 or String scalar, in
+ * turn, with value i and 'attrs' attributes.
+ */
+static libdap::BaseType *make_variable(long long i, long long attrs, bool dap4)
+{
+    string name = numbered("var", i);
+    libdap::BaseType *var;
+
+    switch (i % 4) {
+    case 0: {
+        libdap::Byte *b = new libdap::Byte(name);
+        b->set_value((libdap::dods_byte) i);
+        var = b;
+        break;
+    }
+    case 1: {
+        libdap::Int32 *i32 = new libdap::Int32(name);
+        i32->set_value((libdap::dods_int32) i);
+        var = i32;
+        break;
+    }
+    case 2: {
+        libdap::Float64 *f64 = new libdap::Float64(name);
+        f64->set_value((libdap::dods_float64) i);
+        var = f64;
+        break;
+    }
+    default: {
+        libdap::Str *str = new libdap::Str(name);
+        str->set_value(numbered("value", i));
+        var = str;
+        break;
+    }
+    }
+
+    for (long long j = 0; j < attrs; ++j) {
+        std::ostringstream value;
+        switch (j % 3) {
+        case 0:
+            value << i * attrs + j;
+            add_attribute(var, numbered("attr", j), libdap::attr_int32_c, value.str(), dap4);
+            break;
+        case 1:
+            value << (i * attrs + j) / 8.0;
+            add_attribute(var, numbered("attr", j), libdap::attr_float64_c, value.str(), dap4);
+            break;
+        default:
+            value << "A synthetic attribute of " << name;
+            add_attribute(var, numbered("attr", j), libdap::attr_str_c, value.str(), dap4);
+            break;
+        }
+    }
+
+    var->set_read_p(true);
+    return var;
+}
+
+/*****************************************************************************************
+ * 
+ * SynthDds Function (Debug Functions)
+ * 
+ * This server side function returns a Structure named synth_dds holding
+ * nvars scalar variables (Byte, Int32, Float64 and String in turn) with
+ * attrs_per_var attributes each. With a depth of 0 (the default) the
+ * variables are members of synth_dds itself. Otherwise they are put in
+ * groups of 16, each group at the bottom of its own chain of 'depth'
+ * nested Structures (group_N, level_1, ...). No file is read, so the
+ * time to build, serialize and constrain the DDS/DDX/DMR can be measured
+ * against the size and shape of the schema alone.
+ *
+ * The DAP4 form makes DAP4 attributes, so they appear in the DMR.
+ *
+ */
+string synth_dds_usage = "synth_dds(<nvars> [,<depth> [,<attrs_per_var>]]) Return a Structure of <nvars> variables nested <depth> Structures deep (default 0), each with <attrs_per_var> attributes (default 0).";
+SynthDdsFunc::SynthDdsFunc()
+{
+    setName("synth_dds");
+    setDescriptionString((string) "This function returns a synthetic Structure of many variables and attributes.");
+    setUsageString(synth_dds_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/synth_dds");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::synth_dds_ssf);
+    setFunction(dap4_function<debug_function::synth_dds_dap4_ssf>);
+    setVersion("1.0");
+}
+
+/**
+ * Build the synth_dds response (or a Str holding a usage message).
+ */
+static libdap::BaseType *synth_dds(int argc, libdap::BaseType * argv[], bool dap4)
+{
+    std::stringstream msg;
+
+    long long nvars = 0, depth = 0, attrs = 0;
+    if (argc < 1 || argc > 3) {
+        msg << "Missing number of variables!  USAGE: " << synth_dds_usage;
+    }
+    else if (!get_integer_arg(argv[0], nvars) || nvars < 1 || nvars > MAX_SYNTH_DDS_VARS) {
+        msg << "The number of variables must be an integer between 1 and " << MAX_SYNTH_DDS_VARS << ".  USAGE: "
+            << synth_dds_usage;
+    }
+    else if (argc >= 2 && (!get_integer_arg(argv[1], depth) || depth < 0 || depth > MAX_SYNTH_DDS_DEPTH)) {
+        msg << "The depth must be an integer between 0 and " << MAX_SYNTH_DDS_DEPTH << ".  USAGE: "
+            << synth_dds_usage;
+    }
+    else if (argc == 3 && (!get_integer_arg(argv[2], attrs) || attrs < 0 || attrs > MAX_SYNTH_DDS_ATTRS)) {
+        msg << "The number of attributes must be an integer between 0 and " << MAX_SYNTH_DDS_ATTRS << ".  USAGE: "
+            << synth_dds_usage;
+    }
+    else if (nvars * attrs > MAX_SYNTH_DDS_TOTAL_ATTRS) {
+        msg << "At most " << MAX_SYNTH_DDS_TOTAL_ATTRS << " attributes may be made in all.  USAGE: "
+            << synth_dds_usage;
+    }
+
+    if (!msg.str().empty()) {
+        libdap::Str *response = new libdap::Str("info");
+        response->set_value(msg.str());
+        return response;
+    }
+
+    double start_time = monotonic_ms();
+
+    libdap::Structure *response = new libdap::Structure("synth_dds");
+    libdap::Structure *container = response;
+    for (long long i = 0; i < nvars; ++i) {
+        // Start a new chain of Structures for each group
+        if (depth > 0 && i % SYNTH_DDS_GROUP_VARS == 0) {
+            container = new libdap::Structure(numbered("group", i / SYNTH_DDS_GROUP_VARS));
+            response->add_var_nocopy(container);
+            for (long long level = 1; level < depth; ++level) {
+                libdap::Structure *inner = new libdap::Structure(numbered("level", level));
+                container->add_var_nocopy(inner);
+                container = inner;
+            }
+        }
+
+        container->add_var_nocopy(make_variable(i, attrs, dap4));
+    }
+    response->set_read_p(true);
+
+    BESDEBUG("DebugFunctions", "synth_dds_ssf() - built " << nvars << " variables in " << monotonic_ms() - start_time << " ms" << std::endl);
+
+    return response;
+}
+
+void synth_dds_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("synth_dds", argc, argv);
+
+    *btpp = synth_dds(argc, argv, false);
+}
+
+void synth_dds_dap4_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    TimedCall timed(synth_dds_ssf);
+    FunctionProbe probe("synth_dds", argc, argv);
+
+    *btpp = synth_dds(argc, argv, true);
+}
+
+} // namespace debug_function
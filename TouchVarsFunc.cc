@@ -0,0 +1,326 @@
+// TouchVarsFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <vector>
+
+#include <Str.h>
+#include <Array.h>
+#include <Constructor.h>
+#include <Sequence.h>
+#include <D4Sequence.h>
+#include <D4Group.h>
+#include <DMR.h>
+#include <D4RValue.h>
+#include <ConstraintEvaluator.h>
+#include <GNURegex.h>
+#include <Error.h>
+
+#include "BESDebug.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "FunctionStats.h"
+#include "TouchVarsFunc.h"
+
+namespace debug_function {
+
+long long value_bytes(libdap::BaseType *var)
+{
+    switch (var->type()) {
+    case libdap::dods_str_c:
+    case libdap::dods_url_c:
+        return static_cast<libdap::Str*>(var)->value().size();
+
+    case libdap::dods_array_c: {
+        libdap::Array *array = static_cast<libdap::Array*>(var);
+        libdap::Type type = array->var()->type();
+        if (type == libdap::dods_str_c || type == libdap::dods_url_c) {
+            std::vector<std::string> values;
+            array->value(values);
+            long long bytes = 0;
+            for (std::vector<std::string>::iterator i = values.begin(), e = values.end(); i != e; ++i)
+                bytes += i->size();
+            return bytes;
+        }
+        return array->width(true);
+    }
+
+    case libdap::dods_structure_c: {
+        libdap::Constructor *members = static_cast<libdap::Constructor*>(var);
+        long long bytes = 0;
+        for (libdap::Constructor::Vars_iter i = members->var_begin(), e = members->var_end(); i != e; ++i)
+            bytes += value_bytes(*i);
+        return bytes;
+    }
+
+    case libdap::dods_sequence_c: {
+        // A DAP4 sequence is a D4Sequence, which is not a Sequence
+        libdap::D4Sequence *d4_sequence = dynamic_cast<libdap::D4Sequence*>(var);
+        if (d4_sequence) return (long long) d4_sequence->length() * var->width(true);
+
+        libdap::Sequence *sequence = dynamic_cast<libdap::Sequence*>(var);
+        if (sequence) return (long long) sequence->number_of_rows() * var->width(true);
+
+        return var->width(true);
+    }
+
+    default:
+        return var->width(true);
+    }
+}
+
+/*****************************************************************************************
+ *
+ * TouchVars Function (Debug Functions)
+ *
+ * This server side function forces the data handler to read every
+ * variable in the container's DDS (or those whose names match
+ * the regular expression passed in at argv[0]) and times each read, so
+ * the handler's I/O can be measured without the network in the way.
+ * Each variable is released as soon as it has been measured.
+ *
+ * @note Variables the handler already holds in memory (some handlers
+ * read everything while building the DDS) are reported as such and are
+ * not counted in the throughput.
+ *
+ */
+string touch_vars_usage = "touch_vars([<var_regex>]) Read each variable of the dataset (or those whose names match <var_regex>) and report bytes read and MB/s per variable and in total.";
+TouchVarsFunc::TouchVarsFunc()
+{
+    setName("touch_vars");
+    setDescriptionString((string) "This function reads each variable of the dataset and reports the data handler's throughput.");
+    setUsageString(touch_vars_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/touch_vars");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::touch_vars_ssf);
+    setFunction(debug_function::touch_vars_dap4);
+    setVersion("1.0");
+}
+
+/**
+ * Megabytes per second, or 0 if no time was measured.
+ */
+static double mb_per_sec(long long bytes, double milliseconds)
+{
+    return milliseconds > 0 ? (bytes / 1.0e6) / (milliseconds / 1.0e3) : 0.0;
+}
+
+/**
+ * What touch_vars has measured so far.
+ */
+struct TouchTotals {
+    int touched;
+    long long bytes;
+    double ms;
+    bool cut_short;
+
+    TouchTotals() : touched(0), bytes(0), ms(0.0), cut_short(false) {}
+};
+
+/**
+ * Make the variable name matcher from the optional argument 'arg'. On
+ * error write the reason to 'msg' and return false.
+ */
+static bool make_matcher(libdap::BaseType *arg, libdap::Regex *&matcher, std::ostream &msg)
+{
+    matcher = 0;
+    if (!arg) return true;
+
+    libdap::Str *pattern = dynamic_cast<libdap::Str*>(arg);
+    if (!pattern) {
+        msg << "This function only accepts a string for the variable name pattern.  USAGE: " << touch_vars_usage;
+        return false;
+    }
+
+    try {
+        matcher = new libdap::Regex(pattern->value().c_str());
+    }
+    catch (libdap::Error &e) {
+        msg << "Bad variable name pattern: " << e.get_error_message() << "  USAGE: " << touch_vars_usage;
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Read and measure one variable. A DAP2 variable is read with
+ * intern_data(eval, *dds); pass a null 'dds' for a DAP4 variable.
+ */
+static void touch_var(libdap::BaseType *var, libdap::ConstraintEvaluator &eval, libdap::DDS *dds, std::ostream &msg,
+    TouchTotals &totals)
+{
+    ++totals.touched;
+
+    if (var->read_p()) {
+        msg << var->name() << ": " << var->type_name() << ", " << value_bytes(var) << " bytes already in memory."
+            << std::endl;
+        return;
+    }
+
+    // intern_data() reads the whole variable, including all the rows
+    // of a Sequence; only the parts marked to be sent are kept.
+    var->set_send_p(true);
+    double start_time = monotonic_ms();
+    if (dds)
+        var->intern_data(eval, *dds);
+    else
+        var->intern_data();
+    double read_ms = monotonic_ms() - start_time;
+
+    long long bytes = value_bytes(var);
+    var->clear_local_data();
+
+    BESDEBUG("DebugFunctions", "touch_vars_ssf() - " << var->name() << ": " << bytes << " bytes in " << read_ms << " ms" << std::endl);
+
+    msg << var->name() << ": " << var->type_name() << ", " << bytes << " bytes in " << read_ms << " ms ("
+        << mb_per_sec(bytes, read_ms) << " MB/s)." << std::endl;
+
+    totals.bytes += bytes;
+    totals.ms += read_ms;
+}
+
+/**
+ * Touch the matching variables of 'group' and then of its child groups.
+ */
+static void touch_group(libdap::D4Group *group, libdap::Regex *matcher, const Deadline &deadline,
+    libdap::ConstraintEvaluator &eval, std::ostream &msg, TouchTotals &totals)
+{
+    for (libdap::Constructor::Vars_iter i = group->var_begin(), e = group->var_end(); i != e; ++i) {
+        libdap::BaseType *var = *i;
+        if (matcher && matcher->match(var->name().c_str(), var->name().length()) == -1) continue;
+
+        if (deadline.expired()) {
+            totals.cut_short = true;
+            return;
+        }
+
+        touch_var(var, eval, 0, msg, totals);
+    }
+
+    for (libdap::D4Group::groupsIter g = group->grp_begin(), e = group->grp_end(); g != e && !totals.cut_short; ++g)
+        touch_group(*g, matcher, deadline, eval, msg, totals);
+}
+
+static void write_totals(std::ostream &msg, const TouchTotals &totals)
+{
+    msg << "Touched " << totals.touched << " variables, read " << totals.bytes << " bytes in " << totals.ms << " ms ("
+        << mb_per_sec(totals.bytes, totals.ms) << " MB/s).";
+    if (totals.cut_short) msg << " Cut short by the BES timeout.";
+}
+
+void touch_vars_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("touch_vars", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+    *btpp = response;
+
+    if (argc > 1) {
+        msg << "Too many parameters!  USAGE: " << touch_vars_usage;
+        response->set_value(msg.str());
+        return;
+    }
+
+    libdap::Regex *matcher;
+    if (!make_matcher(argc == 1 ? argv[0] : 0, matcher, msg)) {
+        response->set_value(msg.str());
+        return;
+    }
+
+    Deadline deadline = Deadline::current_request();
+    libdap::ConstraintEvaluator eval;
+    TouchTotals totals;
+
+    try {
+        for (libdap::DDS::Vars_iter i = dds.var_begin(), e = dds.var_end(); i != e; ++i) {
+            libdap::BaseType *var = *i;
+            if (matcher && matcher->match(var->name().c_str(), var->name().length()) == -1) continue;
+
+            if (deadline.expired()) {
+                totals.cut_short = true;
+                break;
+            }
+
+            touch_var(var, eval, &dds, msg, totals);
+        }
+    }
+    catch (...) {
+        delete matcher;
+        throw;
+    }
+
+    delete matcher;
+
+    write_totals(msg, totals);
+    response->set_value(msg.str());
+    return;
+}
+
+libdap::BaseType *touch_vars_dap4(libdap::D4RValueList *args, libdap::DMR &dmr)
+{
+    TimedCall timed(touch_vars_ssf);
+    FunctionProbe probe("touch_vars", 0, 0);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("info");
+
+    unsigned int argc = args ? args->size() : 0;
+    if (argc > 1) {
+        msg << "Too many parameters!  USAGE: " << touch_vars_usage;
+        response->set_value(msg.str());
+        return response;
+    }
+
+    libdap::Regex *matcher;
+    if (!make_matcher(argc == 1 ? args->get_rvalue(0)->value(dmr) : 0, matcher, msg)) {
+        response->set_value(msg.str());
+        return response;
+    }
+
+    Deadline deadline = Deadline::current_request();
+    libdap::ConstraintEvaluator eval;
+    TouchTotals totals;
+
+    try {
+        touch_group(dmr.root(), matcher, deadline, eval, msg, totals);
+    }
+    catch (...) {
+        delete matcher;
+        delete response;
+        throw;
+    }
+
+    delete matcher;
+
+    write_totals(msg, totals);
+    response->set_value(msg.str());
+    return response;
+}
+
+} // namespace debug_function
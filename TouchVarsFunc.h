@@ -0,0 +1,63 @@
+// TouchVarsFunc.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef TOUCHVARSFUNC_H_
+#define TOUCHVARSFUNC_H_
+
+#include <BaseType.h>
+#include <DDS.h>
+#include <DMR.h>
+#include <D4RValue.h>
+#include <ServerFunction.h>
+
+namespace debug_function {
+
+/**
+ * The number of bytes of data held by 'var' (and its members, if it is
+ * a constructor) once it has been read.
+ */
+long long value_bytes(libdap::BaseType *var);
+
+/*****************************************************************************************
+ *
+ * TouchVars Function (Debug Functions)
+ *
+ * This server side function reads each variable of the dataset (or
+ * those whose names match the regular expression at argv[0]) and
+ * reports how long the handler took. (.oO.oO.oO)
+ *
+ * The DAP4 form reads the variables of the DMR's root group and of each
+ * of its child groups.
+ *
+ */
+void touch_vars_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+libdap::BaseType *touch_vars_dap4(libdap::D4RValueList *args, libdap::DMR &dmr);
+class TouchVarsFunc: public libdap::ServerFunction {
+public:
+    TouchVarsFunc();
+    virtual ~TouchVarsFunc(){}
+};
+
+} // namespace debug_function
+#endif /* TOUCHVARSFUNC_H_ */
@@ -0,0 +1,286 @@
+// Trace.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <vector>
+#include <algorithm>
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+#include <Str.h>
+
+#include "BESDebug.h"
+#include "BESUtil.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "Trace.h"
+
+namespace debug_function {
+
+// Threads that can trace at once. A thread holds a buffer from its first
+// event until it exits.
+#define TRACE_BUFFERS 32
+
+// Events kept per buffer, a power of 2; older ones are overwritten
+#define TRACE_BUFFER_EVENTS 4096
+
+struct TraceEvent {
+    uint64_t ns;            // monotonic_ns()
+    const char *name;
+    long long value;
+    int tid;
+    char phase;             // 'B' or 'E', as in the Chrome format
+};
+
+/**
+ * One thread's ring of events. Only the owning thread writes 'events'
+ * and 'head'; it writes an event and then advances 'head', so a reader
+ * sees whole events up to 'head' unless the writer has since wrapped
+ * around onto them. 'start' is the first event not cleared by
+ * trace_dump("clear") and is only written by readers.
+ */
+struct TraceBuffer {
+    volatile int in_use;
+    int tid;                    // of the thread writing now
+    volatile uint64_t head;     // events ever written
+    volatile uint64_t start;
+    TraceEvent events[TRACE_BUFFER_EVENTS];
+};
+
+static TraceBuffer *trace_buffers = 0;
+static pthread_key_t trace_key;
+
+// Events lost because every buffer was in use
+static volatile unsigned long long trace_dropped = 0;
+
+/**
+ * Called when a thread that traced exits: give its buffer back. The
+ * events stay and the next thread to claim it writes after them.
+ */
+static void release_trace_buffer(void *buffer)
+{
+    __sync_lock_release(&static_cast<TraceBuffer*>(buffer)->in_use);
+}
+
+void init_trace()
+{
+    if (trace_buffers || !get_bool_key(DEBUG_FUNCTIONS_TRACE_KEY, true)) return;
+
+    // calloc() so the pages are only touched by the threads that trace
+    TraceBuffer *buffers = static_cast<TraceBuffer*>(calloc(TRACE_BUFFERS, sizeof(TraceBuffer)));
+    if (!buffers || pthread_key_create(&trace_key, release_trace_buffer) != 0) {
+        free(buffers);
+        BESDEBUG("DebugFunctions", "init_trace() - tracing is off; could not make the buffers" << std::endl);
+        return;
+    }
+
+    trace_buffers = buffers;
+}
+
+/**
+ * The calling thread's buffer, claimed on its first event; 0 if tracing
+ * is off or every buffer is in use.
+ */
+static inline TraceBuffer *thread_buffer()
+{
+    if (!trace_buffers) return 0;
+
+    TraceBuffer *buffer = static_cast<TraceBuffer*>(pthread_getspecific(trace_key));
+    if (buffer) return buffer;
+
+    for (int i = 0; i < TRACE_BUFFERS; ++i) {
+        if (!__sync_lock_test_and_set(&trace_buffers[i].in_use, 1)) {
+#ifdef SYS_gettid
+            trace_buffers[i].tid = (int) syscall(SYS_gettid);
+#else
+            trace_buffers[i].tid = i;
+#endif
+            pthread_setspecific(trace_key, &trace_buffers[i]);
+            return &trace_buffers[i];
+        }
+    }
+
+    return 0;
+}
+
+static inline void trace_event(char phase, const char *name, long long value)
+{
+    TraceBuffer *buffer = thread_buffer();
+    if (!buffer) {
+        if (trace_buffers) __sync_fetch_and_add(&trace_dropped, 1ULL);
+        return;
+    }
+
+    TraceEvent &event = buffer->events[buffer->head & (TRACE_BUFFER_EVENTS - 1)];
+    event.ns = monotonic_ns();
+    event.name = name;
+    event.value = value;
+    event.tid = buffer->tid;
+    event.phase = phase;
+
+    __sync_synchronize();
+    buffer->head = buffer->head + 1;
+}
+
+void trace_begin(const char *name, long long value)
+{
+    trace_event('B', name, value);
+}
+
+void trace_end(const char *name)
+{
+    trace_event('E', name, 0);
+}
+
+static bool event_before(const TraceEvent &a, const TraceEvent &b)
+{
+    return a.ns < b.ns;
+}
+
+/**
+ * Write 's' as a JSON string.
+ */
+static void write_json_string(std::ostream &out, const char *s)
+{
+    out << '"';
+    for (; *s; ++s) {
+        if (*s == '"' || *s == '\\')
+            out << '\\' << *s;
+        else if ((unsigned char) *s < 0x20)
+            out << ' ';
+        else
+            out << *s;
+    }
+    out << '"';
+}
+
+/*****************************************************************************************
+ * 
+ * TraceDump Function (Debug Functions)
+ * 
+ * This server side function returns the spans recorded by this
+ * beslistener as Chrome trace event JSON, which chrome://tracing and
+ * Perfetto (ui.perfetto.dev) load directly. Save the value of the
+ * 'trace' string to a .json file.
+ *
+ * Spans are recorded by sleep, sum_until (and its threads), error and
+ * each function timed by function_stats. Each thread writes its own
+ * ring of the last 4096 events without locks, so the oldest events are
+ * lost first and a span whose begin was lost shows as unbalanced. With
+ * "clear" the events returned are dropped from the buffers.
+ *
+ * @note Each beslistener has its own buffers; the pid in the events
+ * tells which one answered.
+ *
+ */
+string trace_dump_usage = "trace_dump([\"clear\"]) Return this beslistener's trace spans as Chrome trace event JSON and, with \"clear\", empty the trace buffers.";
+TraceDumpFunc::TraceDumpFunc()
+{
+    setName("trace_dump");
+    setDescriptionString((string) "This function returns the trace spans recorded by the beslistener as Chrome trace JSON.");
+    setUsageString(trace_dump_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/trace_dump");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::trace_dump_ssf);
+    setFunction(dap4_function<debug_function::trace_dump_ssf>);
+    setVersion("1.0");
+}
+
+void trace_dump_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("trace_dump", argc, argv);
+
+    std::stringstream msg;
+    libdap::Str *response = new libdap::Str("trace");
+    *btpp = response;
+
+    bool clear = false;
+    if (argc > 1) {
+        msg << "Too many parameters!  USAGE: " << trace_dump_usage;
+        response->set_value(msg.str());
+        return;
+    }
+    if (argc == 1) {
+        libdap::Str *param = dynamic_cast<libdap::Str*>(argv[0]);
+        clear = param && BESUtil::lowercase(param->value()) == "clear";
+        if (!clear) {
+            msg << "The only parameter this function accepts is \"clear\".  USAGE: " << trace_dump_usage;
+            response->set_value(msg.str());
+            return;
+        }
+    }
+
+    if (!trace_buffers) {
+        msg << "Tracing is off (" << DEBUG_FUNCTIONS_TRACE_KEY << "=false).";
+        response->set_value(msg.str());
+        return;
+    }
+
+    std::vector<TraceEvent> events;
+    unsigned long long overwritten = 0;
+    for (int i = 0; i < TRACE_BUFFERS; ++i) {
+        TraceBuffer &buffer = trace_buffers[i];
+        uint64_t head = buffer.head;
+        __sync_synchronize();
+        uint64_t first = buffer.start;
+        if (head - first > TRACE_BUFFER_EVENTS) {
+            overwritten += head - first - TRACE_BUFFER_EVENTS;
+            first = head - TRACE_BUFFER_EVENTS;
+        }
+        for (uint64_t e = first; e < head; ++e)
+            events.push_back(buffer.events[e & (TRACE_BUFFER_EVENTS - 1)]);
+        if (clear) buffer.start = head;
+    }
+    std::stable_sort(events.begin(), events.end(), event_before);
+
+    BESDEBUG("DebugFunctions", "trace_dump_ssf() - " << events.size() << " events" << (clear ? ", cleared" : "") << std::endl);
+
+    // Chrome wants microseconds
+    pid_t pid = getpid();
+    msg << "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"overwritten\":" << overwritten << ",\"dropped\":"
+        << trace_dropped << "},\"traceEvents\":[";
+    msg.setf(std::ios::fixed);
+    msg.precision(3);
+    for (std::vector<TraceEvent>::iterator i = events.begin(), e = events.end(); i != e; ++i) {
+        if (i != events.begin()) msg << ",";
+        msg << "\n{\"name\":";
+        write_json_string(msg, i->name);
+        msg << ",\"ph\":\"" << i->phase << "\",\"ts\":" << i->ns / 1.0e3 << ",\"pid\":" << pid << ",\"tid\":"
+            << i->tid;
+        if (i->phase == 'B' && i->value != 0) msg << ",\"args\":{\"value\":" << i->value << "}";
+        msg << "}";
+    }
+    msg << "]}";
+
+    response->set_value(msg.str());
+    return;
+}
+
+} // namespace debug_function
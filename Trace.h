@@ -0,0 +1,94 @@
+// Trace.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <BaseType.h>
+#include <DDS.h>
+#include <ServerFunction.h>
+
+namespace debug_function {
+
+// The BES key that turns span tracing off
+#define DEBUG_FUNCTIONS_TRACE_KEY "DebugFunctions.Trace"
+
+/**
+ * Allocate the trace buffers and read DEBUG_FUNCTIONS_TRACE_KEY. Call
+ * this from initialize(), before the listeners fork; until it is called
+ * (or if tracing is off) the trace calls do nothing.
+ */
+void init_trace();
+
+/**
+ * Record the start or end of the span 'name' on the calling thread.
+ * 'name' must outlive the trace (a string literal, say): only the
+ * pointer is kept. 'value' is shown with a begin event in the trace
+ * viewer. These never allocate or lock; if every buffer is in use by
+ * another thread the event is dropped.
+ */
+void trace_begin(const char *name, long long value = 0);
+void trace_end(const char *name);
+
+/**
+ * A span that ends when it goes out of scope, including by an
+ * exception.
+ */
+class TraceSpan {
+private:
+    const char *d_name;
+
+    TraceSpan(const TraceSpan &);
+    TraceSpan &operator=(const TraceSpan &);
+
+public:
+    explicit TraceSpan(const char *name, long long value = 0) :
+        d_name(name)
+    {
+        trace_begin(name, value);
+    }
+
+    ~TraceSpan()
+    {
+        trace_end(d_name);
+    }
+};
+
+/*****************************************************************************************
+ * 
+ * TraceDump Function (Debug Functions)
+ * 
+ * This server side function returns this beslistener's trace buffers as
+ * Chrome trace event JSON, optionally clearing them. (~~~~~)
+ *
+ */
+void trace_dump_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class TraceDumpFunc: public libdap::ServerFunction {
+public:
+    TraceDumpFunc();
+    virtual ~TraceDumpFunc(){}
+};
+
+} // namespace debug_function
+#endif /* TRACE_H_ */
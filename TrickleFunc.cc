@@ -0,0 +1,189 @@
+// TrickleFunc.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include "config.h"
+
+#include <sstream>      // std::stringstream
+#include <vector>
+#include <climits>
+
+#include <Byte.h>
+#include <Str.h>
+#include <Marshaller.h>
+#include <D4StreamMarshaller.h>
+
+#include "BESDebug.h"
+
+#include "DebugFunctionsUtil.h"
+#include "DebugFunctionsProbes.h"
+#include "TrickleFunc.h"
+
+namespace debug_function {
+
+#define TRICKLE_DEFAULT_CHUNK 4096
+
+// The largest chunk trickle() will write at once
+#define MAX_TRICKLE_CHUNK (16 * 1024 * 1024)
+
+/**
+ * The values of a trickle array are its byte offsets, mod 256, so that
+ * a client can check that nothing was lost or reordered.
+ */
+static void fill_trickle_bytes(libdap::dods_byte *buf, long long offset, unsigned int n)
+{
+    for (unsigned int i = 0; i < n; ++i)
+        buf[i] = (libdap::dods_byte) (offset + i);
+}
+
+TrickleArray::TrickleArray(const std::string &name, int total_bytes, double bytes_per_sec, unsigned int chunk) :
+    libdap::Array(name, 0), d_bytes_per_sec(bytes_per_sec), d_chunk(chunk)
+{
+    add_var_nocopy(new libdap::Byte(name));
+    append_dim(total_bytes, "bytes");
+}
+
+bool TrickleArray::read()
+{
+    if (read_p()) return true;
+
+    reserve_value_capacity(length());
+    fill_trickle_bytes(reinterpret_cast<libdap::dods_byte*>(get_buf()), 0, length());
+    set_read_p(true);
+
+    return true;
+}
+
+void TrickleArray::write_paced(libdap::Marshaller *m, libdap::D4StreamMarshaller *d4m)
+{
+    // Once the length is written every byte must follow, so when the BES
+    // timeout nears the pacing stops and the rest goes out at once.
+    Deadline deadline = Deadline::current_request();
+    bool cut_short = false;
+
+    long long total = length();
+    std::vector<libdap::dods_byte> buf(d_chunk);
+
+    uint64_t start = monotonic_ns();
+    for (long long offset = 0; offset < total; offset += d_chunk) {
+        unsigned int n = total - offset < d_chunk ? total - offset : d_chunk;
+
+        // Chunk k is due once k chunks' worth of time has passed
+        if (!cut_short && offset > 0) {
+            double due_ms = offset / d_bytes_per_sec * 1.0e3;
+            double now_ms = (monotonic_ns() - start) / 1.0e6;
+            if (due_ms > now_ms) sleep_ms(due_ms - now_ms, deadline, cut_short);
+        }
+
+        fill_trickle_bytes(&buf[0], offset, n);
+        if (d4m)
+            d4m->put_vector(reinterpret_cast<char*>(&buf[0]), (int64_t) n);
+        else
+            m->put_vector_part(reinterpret_cast<char*>(&buf[0]), n, 1, libdap::dods_byte_c);
+    }
+
+    BESDEBUG("DebugFunctions", "TrickleArray::write_paced() - wrote " << total << " bytes in "
+        << (monotonic_ns() - start) / 1.0e6 << " ms" << (cut_short ? ", cut short by the BES timeout" : "") << std::endl);
+}
+
+bool TrickleArray::serialize(libdap::ConstraintEvaluator &, libdap::DDS &, libdap::Marshaller &m, bool)
+{
+    m.put_vector_start(length());
+    write_paced(&m, 0);
+    m.put_vector_end();
+
+    return true;
+}
+
+void TrickleArray::serialize(libdap::D4StreamMarshaller &m, libdap::DMR &, bool)
+{
+    // A DAP4 Byte array is its bytes, with no count; each part is added
+    // to the variable's checksum as it is written.
+    write_paced(0, &m);
+}
+
+/*****************************************************************************************
+ * 
+ * Trickle Function (Debug Functions)
+ * 
+ * This server side function returns a Byte array of total_bytes values
+ * that is written to the DAP2 or DAP4 response chunk bytes at a time,
+ * no faster than bytes_per_sec. Nothing is built in memory first; the
+ * time is spent while the response is being sent, so a trickle ties up a
+ * beslistener (and whatever sits between it and the client) the way a
+ * slow back end or a slow client does.
+ *
+ * @note The BES and the front end buffer the response, so chunks
+ * smaller than those buffers may reach the client in bursts. If the
+ * BES timeout nears, the pacing stops and the rest of the array is
+ * sent at once.
+ *
+ */
+string trickle_usage = "trickle(<total_bytes>, <bytes_per_sec> [,<chunk>]) Return <total_bytes> bytes, written to the response <chunk> bytes (default 4096) at a time at <bytes_per_sec>.";
+TrickleFunc::TrickleFunc()
+{
+    setName("trickle");
+    setDescriptionString((string) "This function returns data that is sent slowly.");
+    setUsageString(trickle_usage);
+    setRole("http://services.opendap.org/dap4/server-side-function/debug/trickle");
+    setDocUrl("http://docs.opendap.org/index.php/Debug_Functions");
+    setFunction(debug_function::trickle_ssf);
+    setFunction(dap4_function<debug_function::trickle_ssf>);
+    setVersion("1.0");
+}
+
+void trickle_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &, libdap::BaseType **btpp)
+{
+    FunctionProbe probe("trickle", argc, argv);
+
+    std::stringstream msg;
+
+    long long total_bytes, chunk = TRICKLE_DEFAULT_CHUNK;
+    double bytes_per_sec;
+    if (argc < 2 || argc > 3) {
+        msg << "Missing size or rate!  USAGE: " << trickle_usage;
+    }
+    else if (!get_integer_arg(argv[0], total_bytes) || total_bytes < 0 || total_bytes > INT_MAX) {
+        msg << "The total number of bytes must be an integer between 0 and " << INT_MAX << ".  USAGE: "
+            << trickle_usage;
+    }
+    else if (!get_double_arg(argv[1], bytes_per_sec) || bytes_per_sec <= 0) {
+        msg << "The rate must be a positive number of bytes per second.  USAGE: " << trickle_usage;
+    }
+    else if (argc == 3 && (!get_integer_arg(argv[2], chunk) || chunk < 1 || chunk > MAX_TRICKLE_CHUNK)) {
+        msg << "The chunk size must be an integer between 1 and " << MAX_TRICKLE_CHUNK << ".  USAGE: "
+            << trickle_usage;
+    }
+
+    if (!msg.str().empty()) {
+        libdap::Str *response = new libdap::Str("info");
+        response->set_value(msg.str());
+        *btpp = response;
+        return;
+    }
+
+    *btpp = new TrickleArray("trickle", total_bytes, bytes_per_sec, chunk);
+    return;
+}
+
+} // namespace debug_function
@@ -0,0 +1,88 @@
+// TrickleFunc.h
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+#ifndef TRICKLEFUNC_H_
+#define TRICKLEFUNC_H_
+
+#include <BaseType.h>
+#include <Array.h>
+#include <DDS.h>
+#include <DMR.h>
+#include <ServerFunction.h>
+
+namespace libdap {
+class D4StreamMarshaller;
+}
+
+namespace debug_function {
+
+/**
+ * A Byte array that writes itself slowly. When it is serialized for a
+ * DAP2 or DAP4 response the values are made and written 'chunk' bytes
+ * at a time, each chunk waiting until the elapsed time matches
+ * 'bytes_per_sec'. The whole array is never held in memory. Everywhere
+ * else (read()) it behaves like a normal Byte array.
+ */
+class TrickleArray: public libdap::Array {
+private:
+    double d_bytes_per_sec;
+    unsigned int d_chunk;
+
+    // Write the values to 'm' (DAP2) or 'd4m' (DAP4), whichever is not null
+    void write_paced(libdap::Marshaller *m, libdap::D4StreamMarshaller *d4m);
+
+public:
+    TrickleArray(const std::string &name, int total_bytes, double bytes_per_sec, unsigned int chunk);
+    virtual ~TrickleArray()
+    {
+    }
+
+    virtual libdap::BaseType *ptr_duplicate()
+    {
+        return new TrickleArray(*this);
+    }
+
+    virtual bool read();
+
+    virtual bool serialize(libdap::ConstraintEvaluator &eval, libdap::DDS &dds, libdap::Marshaller &m,
+        bool ce_eval = true);
+    virtual void serialize(libdap::D4StreamMarshaller &m, libdap::DMR &dmr, bool filter = false);
+};
+
+/*****************************************************************************************
+ * 
+ * Trickle Function (Debug Functions)
+ * 
+ * This server side function returns argv[0] bytes that are sent at
+ * argv[1] bytes per second. (. . . . .)
+ *
+ */
+void trickle_ssf(int argc, libdap::BaseType * argv[], libdap::DDS &dds, libdap::BaseType **btpp);
+class TrickleFunc: public libdap::ServerFunction {
+public:
+    TrickleFunc();
+    virtual ~TrickleFunc(){}
+};
+
+} // namespace debug_function
+#endif /* TRICKLEFUNC_H_ */
@@ -0,0 +1,592 @@
+// DebugFunctionsBench.cc
+
+// This file is part of bes, A C++ back-end server implementation framework
+// for the OPeNDAP Data Access Protocol.
+
+// Copyright (c) 2017 OPeNDAP, Inc.
+// Author: Nathan Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+// Microbenchmarks for the debug functions. Run with 'make bench'; the
+// results are written as JSON so that runs from different releases can
+// be compared.
+//
+// Each benchmark is run once to warm up and then for a number of
+// samples. A microbenchmark sample times a batch of iterations and
+// reports the time per iteration; a load function sample is one call.
+
+#include "config.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/utsname.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <BaseType.h>
+#include <Int32.h>
+#include <UInt64.h>
+#include <Float64.h>
+#include <Str.h>
+#include <DDS.h>
+#include <DMR.h>
+#include <D4RValue.h>
+#include <ServerFunctionsList.h>
+
+#include <TheBESKeys.h>
+#include <BESDebug.h>
+#include <BESError.h>
+
+#include "GetOpt.h"
+
+#include "DebugFunctions.h"
+#include "DebugFunctionsUtil.h"
+#include "BarrierFunc.h"
+
+using namespace std;
+using namespace debug_function;
+
+// The file the I/O and page cache functions read. It is made in the
+// current directory, which bes.conf makes the catalog root.
+#define BENCH_DATA_FILE "bench_data.bin"
+#define BENCH_DATA_BYTES (16 * 1024 * 1024)
+
+// Results go here so the compiler cannot drop the work being timed
+static volatile long long sink;
+
+struct BenchResult {
+    string name;
+    string kind;            // "micro" or "load"
+    long long iterations;   // per sample
+    vector<double> ns;      // per iteration, one per sample
+    string response;        // the last response of a load function
+};
+
+/*****************************************************************************************
+ *
+ * The operations timed. Each is a functor so the timing loop can inline it.
+ *
+ */
+
+/** Look up a function by name, as the constraint evaluator does. */
+struct FindFunction {
+    string name;
+    void operator()()
+    {
+        libdap::btp_func f = 0;
+        libdap::ServerFunctionsList::TheList()->find_function(name, &f);
+        sink += (f != 0);
+    }
+};
+
+/** Look up a function and call it with 'argc' and 'argv'. */
+struct CallFunction {
+    string name;
+    int argc;
+    libdap::BaseType **argv;
+    libdap::DDS *dds;
+    string response;
+
+    void operator()()
+    {
+        libdap::btp_func f = 0;
+        if (!libdap::ServerFunctionsList::TheList()->find_function(name, &f))
+            throw libdap::Error("No server function named " + name);
+
+        libdap::BaseType *result = 0;
+        f(argc, argv, *dds, &result);
+
+        libdap::Str *info = dynamic_cast<libdap::Str*>(result);
+        if (info) response = info->value();
+        delete result;
+    }
+};
+
+/** Call a DAP2 function directly, without the lookup or the timing wrapper. */
+struct CallDirect {
+    libdap::btp_func function;
+    int argc;
+    libdap::BaseType **argv;
+    libdap::DDS *dds;
+
+    void operator()()
+    {
+        libdap::BaseType *result = 0;
+        function(argc, argv, *dds, &result);
+        delete result;
+    }
+};
+
+/** Look up the DAP4 form of a function and call it with 'args'. */
+struct CallDap4 {
+    string name;
+    libdap::D4RValueList *args;
+    libdap::DMR *dmr;
+
+    void operator()()
+    {
+        libdap::D4Function f = 0;
+        if (!libdap::ServerFunctionsList::TheList()->find_function(name, &f))
+            throw libdap::Error("No DAP4 server function named " + name);
+
+        delete f(args, *dmr);
+    }
+};
+
+/** Decode an integer argument. */
+struct DecodeInteger {
+    libdap::BaseType *arg;
+    void operator()()
+    {
+        long long value = 0;
+        get_integer_arg(arg, value);
+        sink += value;
+    }
+};
+
+/** Decode a number argument. */
+struct DecodeDouble {
+    libdap::BaseType *arg;
+    void operator()()
+    {
+        double value = 0;
+        get_double_arg(arg, value);
+        sink += (long long) value;
+    }
+};
+
+/** Build and free an "info" response, as nearly every function does. */
+struct BuildResponse {
+    long long n;
+    void operator()()
+    {
+        std::stringstream msg;
+        msg << "Summed " << ++n << " terms in " << 1.5 << " ms.";
+        libdap::Str *response = new libdap::Str("info");
+        response->set_value(msg.str());
+        sink += response->value().size();
+        delete response;
+    }
+};
+
+/**
+ * Run 'op' once to warm up, then 'samples' times 'iterations' times and
+ * record the time per iteration of each sample.
+ */
+template<class Op>
+static BenchResult run_bench(const string &name, const string &kind, Op &op, long long iterations, int samples)
+{
+    BenchResult result;
+    result.name = name;
+    result.kind = kind;
+    result.iterations = iterations;
+
+    op();
+
+    for (int s = 0; s < samples; ++s) {
+        uint64_t start_ns = monotonic_ns();
+        for (long long i = 0; i < iterations; ++i)
+            op();
+        result.ns.push_back((double) (monotonic_ns() - start_ns) / iterations);
+    }
+
+    return result;
+}
+
+/*****************************************************************************************
+ *
+ * JSON output
+ *
+ */
+
+static void write_json_string(ostream &out, const string &s)
+{
+    out << '"';
+    for (string::const_iterator i = s.begin(), e = s.end(); i != e; ++i) {
+        switch (*i) {
+        case '"':
+        case '\\':
+            out << '\\' << *i;
+            break;
+        case '\n':
+            out << "\\n";
+            break;
+        case '\t':
+            out << "\\t";
+            break;
+        default:
+            if ((unsigned char) *i < 0x20)
+                out << ' ';
+            else
+                out << *i;
+        }
+    }
+    out << '"';
+}
+
+static void write_json(ostream &out, const vector<BenchResult> &results)
+{
+    time_t now = time(0);
+    char timestamp[32];
+    strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    struct utsname host;
+    uname(&host);
+
+    out.precision(12);
+    out << "{" << endl;
+    out << "  \"module\": \"" << PACKAGE_NAME << "\"," << endl;
+    out << "  \"version\": \"" << PACKAGE_VERSION << "\"," << endl;
+    out << "  \"timestamp\": \"" << timestamp << "\"," << endl;
+    out << "  \"host\": ";
+    write_json_string(out, host.nodename);
+    out << "," << endl << "  \"kernel\": ";
+    write_json_string(out, string(host.release) + " " + host.machine);
+    out << "," << endl << "  \"cpus\": " << sysconf(_SC_NPROCESSORS_ONLN) << "," << endl;
+    out << "  \"benchmarks\": [" << endl;
+
+    for (vector<BenchResult>::const_iterator r = results.begin(), e = results.end(); r != e; ++r) {
+        vector<double> ns = r->ns;
+        double total = 0;
+        for (vector<double>::iterator i = ns.begin(), e = ns.end(); i != e; ++i)
+            total += *i;
+        sort(ns.begin(), ns.end());
+
+        out << "    {\"name\": \"" << r->name << "\", \"kind\": \"" << r->kind << "\", \"unit\": \"ns\", \"iterations\": "
+            << r->iterations << ", \"samples\": " << ns.size() << ", \"min\": " << ns.front() << ", \"p50\": "
+            << percentile(ns, 50) << ", \"p90\": " << percentile(ns, 90) << ", \"max\": " << ns.back()
+            << ", \"mean\": " << total / ns.size();
+        if (!r->response.empty()) {
+            out << ", \"response\": ";
+            write_json_string(out, r->response);
+        }
+        out << "}" << (r + 1 != e ? "," : "") << endl;
+    }
+
+    out << "  ]" << endl << "}" << endl;
+}
+
+/*****************************************************************************************
+ *
+ * The benchmarks
+ *
+ */
+
+static bool selected(const string &name, const string &filter)
+{
+    return filter.empty() || name.find(filter) != string::npos;
+}
+
+static void make_data_file()
+{
+    int fd = open(BENCH_DATA_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) throw libdap::Error(string("Could not make ") + BENCH_DATA_FILE);
+
+    vector<char> block(1024 * 1024);
+    RandomSource random(1);
+    for (size_t i = 0; i < block.size(); ++i)
+        block[i] = (char) random.next();
+
+    for (int i = 0; i < BENCH_DATA_BYTES / (int) block.size(); ++i) {
+        if (write(fd, &block[0], block.size()) != (ssize_t) block.size()) {
+            close(fd);
+            throw libdap::Error(string("Could not write ") + BENCH_DATA_FILE);
+        }
+    }
+    close(fd);
+}
+
+/**
+ * A load function benchmark: the function's name and arguments, as they
+ * would appear in a constraint expression.
+ *
+ * touch_vars() and trickle() need a data handler and a response stream,
+ * so they are left to the bescmd tests. chaos() is only run with the
+ * outcomes that return (none, delay); its error outcome is error()'s and
+ * its abort outcome would end the benchmark.
+ */
+struct LoadBench {
+    const char *name;       // the benchmark's name
+    const char *function;
+    const char *args;       // comma separated; quoted values are strings
+};
+
+static LoadBench load_benches[] = {
+    { "load.sum_n", "sum_n", "1000000" },
+    { "load.sum_until", "sum_until", "10" },
+    { "load.sleep", "sleep", "1" },
+    { "load.sleep_dist", "sleep_dist", "\"constant\",1,0" },
+    { "load.chaos.none", "chaos", "0,0,0" },
+    { "load.chaos.delay", "chaos", "0,1,0,3,\"constant:1:0\"" },
+    { "load.alloc", "alloc", "16777216,0" },
+    { "load.synth_array", "synth_array", "\"Float64\",256,256" },
+    { "load.synth_dds", "synth_dds", "100,2,4" },
+    { "load.io_read.pread", "io_read", "\"" BENCH_DATA_FILE "\",0,\"pread\"" },
+    { "load.io_read.mmap", "io_read", "\"" BENCH_DATA_FILE "\",0,\"mmap\"" },
+    { "load.io_pattern.random", "io_pattern", "\"" BENCH_DATA_FILE "\",4096,\"random\",8,1024" },
+    { "load.warm_cache", "warm_cache", "\"" BENCH_DATA_FILE "\"" },
+    { "load.drop_cache", "drop_cache", "\"" BENCH_DATA_FILE "\"" },
+    { "load.error_storm", "error_storm", "3,1000" },
+    { "load.membw.triad", "membw", "8388608,\"triad\"" },
+    { "load.compute.reduction", "compute", "\"reduction\",1048576" },
+    { "load.compute.stencil", "compute", "\"stencil\",1048576" },
+    { "load.compute.matmul", "compute", "\"matmul\",128" },
+    { "load.compute.hash", "compute", "\"hash\",1048576" },
+    { "load.compute.byteswap", "compute", "\"byteswap\",1048576" },
+    { "load.fork_probe", "fork_probe", "5,1048576" },
+    { "load.barrier", "barrier", "\"bench\",1" },
+    { "load.rusage", "rusage", "" },
+    { 0, 0, 0 }
+};
+
+/**
+ * Make the arguments in 'args' (see LoadBench). The caller deletes them.
+ */
+static vector<libdap::BaseType*> make_args(const string &args)
+{
+    vector<libdap::BaseType*> argv;
+    std::stringstream in(args);
+    string arg;
+    while (getline(in, arg, ',')) {
+        if (arg.size() >= 2 && arg[0] == '"') {
+            libdap::Str *s = new libdap::Str("arg");
+            s->set_value(arg.substr(1, arg.size() - 2));
+            argv.push_back(s);
+        }
+        else {
+            // As the constraint expression parser does: Int32 if it fits
+            double value = atof(arg.c_str());
+            if (arg.find('.') == string::npos && value >= INT32_MIN && value <= INT32_MAX) {
+                libdap::Int32 *i = new libdap::Int32("arg");
+                i->set_value((libdap::dods_int32) value);
+                argv.push_back(i);
+            }
+            else {
+                libdap::Float64 *f = new libdap::Float64("arg");
+                f->set_value(value);
+                argv.push_back(f);
+            }
+        }
+    }
+    return argv;
+}
+
+static void run_micro_benches(const string &filter, int samples, vector<BenchResult> &results)
+{
+    libdap::DDS dds(0);
+    libdap::DMR dmr;
+
+    libdap::Int32 one("one");
+    one.set_value(1);
+    libdap::Float64 big("big");
+    big.set_value(4294967296.0);
+    libdap::UInt64 ubig("ubig");
+    ubig.set_value(4294967296ULL);
+    libdap::BaseType *argv[] = { &one };
+
+    if (selected("dispatch.find_function", filter)) {
+        FindFunction op;
+        op.name = "sum_n";
+        results.push_back(run_bench("dispatch.find_function", "micro", op, 100000, samples));
+    }
+    if (selected("dispatch.call", filter)) {
+        CallFunction op;
+        op.name = "sum_n";
+        op.argc = 1;
+        op.argv = argv;
+        op.dds = &dds;
+        results.push_back(run_bench("dispatch.call", "micro", op, 10000, samples));
+    }
+    if (selected("dispatch.call_direct", filter)) {
+        CallDirect op;
+        op.function = sum_n_ssf;
+        op.argc = 1;
+        op.argv = argv;
+        op.dds = &dds;
+        results.push_back(run_bench("dispatch.call_direct", "micro", op, 10000, samples));
+    }
+    if (selected("dispatch.call_dap4", filter)) {
+        libdap::D4RValueList args;
+        args.add_rvalue(new libdap::D4RValue((long long) 1));
+        CallDap4 op;
+        op.name = "sum_n";
+        op.args = &args;
+        op.dmr = &dmr;
+        results.push_back(run_bench("dispatch.call_dap4", "micro", op, 10000, samples));
+    }
+    if (selected("decode.integer.int32", filter)) {
+        DecodeInteger op;
+        op.arg = &one;
+        results.push_back(run_bench("decode.integer.int32", "micro", op, 1000000, samples));
+    }
+    if (selected("decode.integer.float64", filter)) {
+        DecodeInteger op;
+        op.arg = &big;
+        results.push_back(run_bench("decode.integer.float64", "micro", op, 1000000, samples));
+    }
+    if (selected("decode.integer.uint64", filter)) {
+        DecodeInteger op;
+        op.arg = &ubig;
+        results.push_back(run_bench("decode.integer.uint64", "micro", op, 1000000, samples));
+    }
+    if (selected("decode.double.int32", filter)) {
+        DecodeDouble op;
+        op.arg = &one;
+        results.push_back(run_bench("decode.double.int32", "micro", op, 1000000, samples));
+    }
+    if (selected("response.str", filter)) {
+        BuildResponse op;
+        op.n = 0;
+        results.push_back(run_bench("response.str", "micro", op, 100000, samples));
+    }
+}
+
+static void run_load_benches(const string &filter, int samples, vector<BenchResult> &results)
+{
+    libdap::DDS dds(0);
+
+    for (LoadBench *b = load_benches; b->name; ++b) {
+        if (!selected(b->name, filter)) continue;
+
+        cerr << b->name << "..." << endl;
+
+        vector<libdap::BaseType*> args = make_args(b->args);
+        CallFunction op;
+        op.name = b->function;
+        op.argc = args.size();
+        op.argv = args.empty() ? 0 : &args[0];
+        op.dds = &dds;
+
+        try {
+            results.push_back(run_bench(b->name, "load", op, 1, samples));
+            results.back().response = op.response;
+        }
+        catch (...) {
+            for (vector<libdap::BaseType*>::iterator i = args.begin(), e = args.end(); i != e; ++i)
+                delete *i;
+            throw;
+        }
+
+        for (vector<libdap::BaseType*>::iterator i = args.begin(), e = args.end(); i != e; ++i)
+            delete *i;
+    }
+
+    // Remove the barrier's shared memory
+    libdap::Str name("name");
+    name.set_value("bench");
+    libdap::Int32 zero("zero");
+    zero.set_value(0);
+    libdap::BaseType *argv[] = { &name, &zero };
+    CallDirect unlink_barrier;
+    unlink_barrier.function = barrier_ssf;
+    unlink_barrier.argc = 2;
+    unlink_barrier.argv = argv;
+    unlink_barrier.dds = &dds;
+    unlink_barrier();
+}
+
+static void usage(const char *name)
+{
+    cerr << "Usage: " << name << " [-c bes.conf] [-o results.json] [-s samples] [-f filter] [-d]" << endl;
+    cerr << "    -c  The BES configuration file (default: bes.conf)" << endl;
+    cerr << "    -o  Write the results here (default: the standard output)" << endl;
+    cerr << "    -s  Samples per benchmark (default: 15 for microbenchmarks, 5 for load functions)" << endl;
+    cerr << "    -f  Run only the benchmarks whose names contain this string" << endl;
+    cerr << "    -d  Turn on BES debugging output" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string conf = "bes.conf";
+    string output;
+    string filter;
+    int samples = 0;
+
+    GetOpt getopt(argc, argv, "c:o:s:f:dh");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'c':
+            conf = getopt.optarg;
+            break;
+        case 'o':
+            output = getopt.optarg;
+            break;
+        case 's':
+            samples = atoi(getopt.optarg);
+            break;
+        case 'f':
+            filter = getopt.optarg;
+            break;
+        case 'd':
+            BESDebug::SetUp("cerr,DebugFunctions");
+            break;
+        case 'h':
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+
+    try {
+        TheBESKeys::ConfigFile = conf;
+
+        DebugFunctions module;
+        module.initialize("debug_functions");
+
+        make_data_file();
+
+        vector<BenchResult> results;
+        run_micro_benches(filter, samples > 0 ? samples : 15, results);
+        run_load_benches(filter, samples > 0 ? samples : 5, results);
+
+        unlink(BENCH_DATA_FILE);
+
+        if (output.empty()) {
+            write_json(cout, results);
+        }
+        else {
+            ofstream out(output.c_str());
+            write_json(out, results);
+            if (!out) {
+                cerr << "Could not write " << output << endl;
+                return 1;
+            }
+        }
+    }
+    catch (BESError &e) {
+        cerr << "Error: " << e.get_message() << endl;
+        unlink(BENCH_DATA_FILE);
+        return 1;
+    }
+    catch (libdap::Error &e) {
+        cerr << "Error: " << e.get_error_message() << endl;
+        unlink(BENCH_DATA_FILE);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,212 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#define DODS_DEBUG
+
+#include <BESDebug.h>
+
+#include "util.h"
+#include "debug.h"
+#include "Array.h"
+#include "Int32.h"
+#include "Float64.h"
+#include "Str.h"
+#include "DebugFunctions.h"
+#include <BaseTypeFactory.h>
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+class AllocFunctionTest: public CppUnit::TestFixture {
+private:
+    BaseTypeFactory btf;
+    DDS *testDDS;
+
+public:
+    // Called once before everything gets tested
+    AllocFunctionTest() :testDDS(0)
+    {
+
+    }
+
+    // Called at the end of the test
+    ~AllocFunctionTest()
+    {
+    }
+
+    // Called before each test
+    void setUp()
+    {
+        try {
+            testDDS = new DDS(&btf);
+        }
+        catch (Error & e) {
+            cerr << "SetUp: " << e.get_error_message() << endl;
+            throw;
+        }
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+        delete testDDS;
+    }
+
+CPPUNIT_TEST_SUITE( AllocFunctionTest );
+
+    CPPUNIT_TEST(sequentialAllocFunctionTest);
+    CPPUNIT_TEST(randomAllocFunctionTest);
+    CPPUNIT_TEST(badPatternAllocFunctionTest);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    string alloc(int argc, libdap::BaseType *argv[])
+    {
+        debug_function::AllocFunc allocFunc;
+
+        libdap::btp_func alloc_function = allocFunc.get_btp_func();
+
+        libdap::BaseType *result = 0;
+        libdap::BaseType **btpp = &result;
+
+        alloc_function(argc, argv, *testDDS, btpp);
+
+        libdap::Str *info = dynamic_cast<libdap::Str*>(result);
+        CPPUNIT_ASSERT(info);
+        string value = info->value();
+        delete result;
+
+        DBG(cerr << value << endl);
+        return value;
+    }
+
+    void sequentialAllocFunctionTest()
+    {
+        DBG(cerr << endl << "sequentialAllocFunctionTest() - BEGIN." << endl);
+
+        libdap::Int32 bytes("bytes");
+        bytes.set_value(16 * 1024 * 1024);
+        libdap::Int32 time("time");
+        time.set_value(10);
+        libdap::BaseType *argv[] = { &bytes, &time };
+
+        string value = alloc(2, argv);
+        CPPUNIT_ASSERT(value.find("Allocated 16777216 bytes") == 0);
+        CPPUNIT_ASSERT(value.find("Held for 10 ms.") != string::npos);
+
+        DBG(cerr << "sequentialAllocFunctionTest() - END." << endl);
+    }
+
+    void randomAllocFunctionTest()
+    {
+        DBG(cerr << endl << "randomAllocFunctionTest() - BEGIN." << endl);
+
+        libdap::Float64 bytes("bytes");
+        bytes.set_value(1000000);
+        libdap::Int32 time("time");
+        time.set_value(0);
+        libdap::Str pattern("pattern");
+        pattern.set_value("random");
+        libdap::Int32 hugepages("hugepages");
+        hugepages.set_value(1);
+        libdap::BaseType *argv[] = { &bytes, &time, &pattern, &hugepages };
+
+        string value = alloc(4, argv);
+        CPPUNIT_ASSERT(value.find("Allocated ") == 0);
+        CPPUNIT_ASSERT(value.find("MADV_HUGEPAGE") != string::npos);
+
+        DBG(cerr << "randomAllocFunctionTest() - END." << endl);
+    }
+
+    void badPatternAllocFunctionTest()
+    {
+        DBG(cerr << endl << "badPatternAllocFunctionTest() - BEGIN." << endl);
+
+        libdap::Int32 bytes("bytes");
+        bytes.set_value(4096);
+        libdap::Int32 time("time");
+        time.set_value(0);
+        libdap::Str pattern("pattern");
+        pattern.set_value("backwards");
+        libdap::BaseType *argv[] = { &bytes, &time, &pattern };
+
+        string value = alloc(3, argv);
+        CPPUNIT_ASSERT(value.find("Unknown touch pattern") == 0);
+
+        DBG(cerr << "badPatternAllocFunctionTest() - END." << endl);
+    }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(AllocFunctionTest);
+
+} /* namespace libdap */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = true;  // debug is a static global
+            BESDebug::SetUp("cerr,DebugFunctions");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::AllocFunctionTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
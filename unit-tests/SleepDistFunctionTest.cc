@@ -0,0 +1,223 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#define DODS_DEBUG
+
+#include <BESDebug.h>
+
+#include "util.h"
+#include "debug.h"
+#include "Array.h"
+#include "Int32.h"
+#include "Float64.h"
+#include "Str.h"
+#include "SleepDistFunc.h"
+#include <BaseTypeFactory.h>
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+class SleepDistFunctionTest: public CppUnit::TestFixture {
+private:
+    BaseTypeFactory btf;
+    DDS *testDDS;
+
+public:
+    // Called once before everything gets tested
+    SleepDistFunctionTest() :testDDS(0)
+    {
+
+    }
+
+    // Called at the end of the test
+    ~SleepDistFunctionTest()
+    {
+    }
+
+    // Called before each test
+    void setUp()
+    {
+        try {
+            testDDS = new DDS(&btf);
+        }
+        catch (Error & e) {
+            cerr << "SetUp: " << e.get_error_message() << endl;
+            throw;
+        }
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+        delete testDDS;
+    }
+
+CPPUNIT_TEST_SUITE( SleepDistFunctionTest );
+
+    CPPUNIT_TEST(constantSleepDistFunctionTest);
+    CPPUNIT_TEST(badDistSleepDistFunctionTest);
+    CPPUNIT_TEST(exponentialMeanTest);
+    CPPUNIT_TEST(paretoMinimumTest);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void constantSleepDistFunctionTest()
+    {
+        DBG(cerr << endl << "constantSleepDistFunctionTest() - BEGIN." << endl);
+
+        debug_function::SleepDistFunc sleepDistFunc;
+
+        libdap::btp_func sleep_dist_function = sleepDistFunc.get_btp_func();
+
+        libdap::Str dist("dist");
+        dist.set_value("constant");
+        libdap::Float64 p1("p1");
+        p1.set_value(100.0);
+        libdap::Int32 p2("p2");
+        p2.set_value(0);
+        libdap::BaseType *argv[] = { &dist, &p1, &p2 };
+        libdap::BaseType *result = 0;
+        libdap::BaseType **btpp = &result;
+
+        sleep_dist_function(3, argv, *testDDS, btpp);
+
+        libdap::Str *info = dynamic_cast<libdap::Str*>(result);
+        CPPUNIT_ASSERT(info);
+        DBG(cerr << info->value() << endl);
+        CPPUNIT_ASSERT(info->value().find("Drew 100 ms from constant(100, 0); slept for ") == 0);
+
+        delete result;
+
+        DBG(cerr << "constantSleepDistFunctionTest() - END." << endl);
+    }
+
+    void badDistSleepDistFunctionTest()
+    {
+        DBG(cerr << endl << "badDistSleepDistFunctionTest() - BEGIN." << endl);
+
+        debug_function::SleepDistFunc sleepDistFunc;
+
+        libdap::btp_func sleep_dist_function = sleepDistFunc.get_btp_func();
+
+        libdap::Str dist("dist");
+        dist.set_value("cauchy");
+        libdap::Int32 p1("p1");
+        p1.set_value(1);
+        libdap::Int32 p2("p2");
+        p2.set_value(1);
+        libdap::BaseType *argv[] = { &dist, &p1, &p2 };
+        libdap::BaseType *result = 0;
+        libdap::BaseType **btpp = &result;
+
+        sleep_dist_function(3, argv, *testDDS, btpp);
+
+        libdap::Str *info = dynamic_cast<libdap::Str*>(result);
+        CPPUNIT_ASSERT(info);
+        CPPUNIT_ASSERT(info->value().find("Unknown distribution.") == 0);
+
+        delete result;
+
+        DBG(cerr << "badDistSleepDistFunctionTest() - END." << endl);
+    }
+
+    void exponentialMeanTest()
+    {
+        DBG(cerr << endl << "exponentialMeanTest() - BEGIN." << endl);
+
+        debug_function::RandomSource random(42);
+        const int n = 100000;
+        double sum = 0.0;
+        for (int i = 0; i < n; ++i)
+            sum += debug_function::draw_delay_ms(debug_function::delay_exponential, 10.0, 5.0, random);
+
+        DBG(cerr << "mean: " << sum / n << endl);
+        CPPUNIT_ASSERT(sum / n > 14.7 && sum / n < 15.3);
+
+        DBG(cerr << "exponentialMeanTest() - END." << endl);
+    }
+
+    void paretoMinimumTest()
+    {
+        DBG(cerr << endl << "paretoMinimumTest() - BEGIN." << endl);
+
+        debug_function::RandomSource random(42);
+        for (int i = 0; i < 10000; ++i)
+            CPPUNIT_ASSERT(debug_function::draw_delay_ms(debug_function::delay_pareto, 2.0, 1.5, random) >= 2.0);
+
+        DBG(cerr << "paretoMinimumTest() - END." << endl);
+    }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SleepDistFunctionTest);
+
+} /* namespace libdap */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = true;  // debug is a static global
+            BESDebug::SetUp("cerr,DebugFunctions");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::SleepDistFunctionTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}
@@ -29,12 +29,14 @@
 #define DODS_DEBUG
 
 #include <BESDebug.h>
+#include <BESContextManager.h>
 
 #include "util.h"
 #include "debug.h"
 #include "Array.h"
 #include "Int32.h"
 #include "Float64.h"
+#include "Str.h"
 #include "DebugFunctions.h"
 #include <BaseTypeFactory.h>
 
@@ -85,6 +87,7 @@ public:
 CPPUNIT_TEST_SUITE( SleepFunctionTest );
 
     CPPUNIT_TEST(sleepFunctionTest);
+    CPPUNIT_TEST(sleepTimeoutTest);
 
     CPPUNIT_TEST_SUITE_END()
     ;
@@ -115,6 +118,34 @@ CPPUNIT_TEST_SUITE( SleepFunctionTest );
         DBG(cerr << "sleepFunctionTest() - END." << endl);
     }
 
+    // With a one second bes_timeout, a ten second sleep must wake up early
+    void sleepTimeoutTest()
+    {
+        DBG(cerr << endl << "sleepTimeoutTest() - BEGIN." << endl);
+
+        BESContextManager::TheManager()->set_context("bes_timeout", "1");
+
+        debug_function::SleepFunc sleepFunc;
+        libdap::btp_func sleep_function = sleepFunc.get_btp_func();
+
+        libdap::Int32 time("time");
+        time.set_value(10000);
+        libdap::BaseType *argv[] = { &time };
+        libdap::BaseType *result = 0;
+
+        sleep_function(1, argv, *testDDS, &result);
+        BESContextManager::TheManager()->unset_context("bes_timeout");
+
+        libdap::Str *info = dynamic_cast<libdap::Str*>(result);
+        CPPUNIT_ASSERT(info);
+        DBG(cerr << "sleepTimeoutTest() - " << info->value() << endl);
+        CPPUNIT_ASSERT(info->value().find("cut short by the BES timeout") != string::npos);
+
+        delete result;
+
+        DBG(cerr << "sleepTimeoutTest() - END." << endl);
+    }
+
 };
 
 CPPUNIT_TEST_SUITE_REGISTRATION(SleepFunctionTest);
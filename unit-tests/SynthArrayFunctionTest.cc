@@ -0,0 +1,241 @@
+// -*- mode: c++; c-basic-offset:4 -*-
+
+// This file is part of libdap, A C++ implementation of the OPeNDAP Data
+// Access Protocol.
+
+// Copyright (c) 2005 OPeNDAP, Inc.
+// Author: Nathan David Potter <ndp@opendap.org>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+//
+// You can contact OPeNDAP, Inc. at PO Box 112, Saunderstown, RI. 02874-0112.
+
+#include <cppunit/TextTestRunner.h>
+#include <cppunit/extensions/TestFactoryRegistry.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#define DODS_DEBUG
+
+#include <BESDebug.h>
+
+#include "util.h"
+#include "debug.h"
+#include "Array.h"
+#include "Int32.h"
+#include "Float64.h"
+#include "Str.h"
+#include "SynthArrayFunc.h"
+#include <BaseTypeFactory.h>
+
+#include "GetOpt.h"
+
+static bool debug = false;
+
+#undef DBG
+#define DBG(x) do { if (debug) (x); } while(false);
+
+namespace libdap {
+
+class SynthArrayFunctionTest: public CppUnit::TestFixture {
+private:
+    BaseTypeFactory btf;
+    DDS *testDDS;
+
+public:
+    // Called once before everything gets tested
+    SynthArrayFunctionTest() :testDDS(0)
+    {
+
+    }
+
+    // Called at the end of the test
+    ~SynthArrayFunctionTest()
+    {
+    }
+
+    // Called before each test
+    void setUp()
+    {
+        try {
+            testDDS = new DDS(&btf);
+        }
+        catch (Error & e) {
+            cerr << "SetUp: " << e.get_error_message() << endl;
+            throw;
+        }
+    }
+
+    // Called after each test
+    void tearDown()
+    {
+        delete testDDS;
+    }
+
+CPPUNIT_TEST_SUITE( SynthArrayFunctionTest );
+
+    CPPUNIT_TEST(rampFunctionTest);
+    CPPUNIT_TEST(randomFunctionTest);
+    CPPUNIT_TEST(badTypeFunctionTest);
+
+    CPPUNIT_TEST_SUITE_END()
+    ;
+
+    void rampFunctionTest()
+    {
+        DBG(cerr << endl << "rampFunctionTest() - BEGIN." << endl);
+
+        debug_function::SynthArrayFunc synthArrayFunc;
+
+        libdap::btp_func synth_array_function = synthArrayFunc.get_btp_func();
+
+        libdap::Str type("type");
+        type.set_value("Int32");
+        libdap::Int32 dim1("dim1");
+        dim1.set_value(3);
+        libdap::Int32 dim2("dim2");
+        dim2.set_value(4);
+        libdap::Str pattern("pattern");
+        pattern.set_value("ramp");
+        libdap::BaseType *argv[] = { &type, &dim1, &dim2, &pattern };
+        libdap::BaseType *result = 0;
+        libdap::BaseType **btpp = &result;
+
+        synth_array_function(4, argv, *testDDS, btpp);
+
+        libdap::Array *array = dynamic_cast<libdap::Array*>(result);
+        CPPUNIT_ASSERT(array);
+        CPPUNIT_ASSERT(array->var()->type() == dods_int32_c);
+        CPPUNIT_ASSERT(array->dimensions() == 2);
+        CPPUNIT_ASSERT(array->length() == 12);
+
+        vector<dods_int32> values(12);
+        array->value(&values[0]);
+        for (int i = 0; i < 12; ++i)
+            CPPUNIT_ASSERT(values[i] == i);
+
+        delete result;
+
+        DBG(cerr << "rampFunctionTest() - END." << endl);
+    }
+
+    void randomFunctionTest()
+    {
+        DBG(cerr << endl << "randomFunctionTest() - BEGIN." << endl);
+
+        debug_function::SynthArrayFunc synthArrayFunc;
+
+        libdap::btp_func synth_array_function = synthArrayFunc.get_btp_func();
+
+        libdap::Str type("type");
+        type.set_value("float64");
+        libdap::Int32 dim1("dim1");
+        dim1.set_value(1000);
+        libdap::Str pattern("pattern");
+        pattern.set_value("random");
+        libdap::BaseType *argv[] = { &type, &dim1, &pattern };
+        libdap::BaseType *result = 0;
+        libdap::BaseType **btpp = &result;
+
+        synth_array_function(3, argv, *testDDS, btpp);
+
+        libdap::Array *array = dynamic_cast<libdap::Array*>(result);
+        CPPUNIT_ASSERT(array);
+        CPPUNIT_ASSERT(array->var()->type() == dods_float64_c);
+        CPPUNIT_ASSERT(array->length() == 1000);
+
+        vector<dods_float64> values(1000);
+        array->value(&values[0]);
+        for (int i = 0; i < 1000; ++i)
+            CPPUNIT_ASSERT(values[i] >= 0.0 && values[i] < 1.0);
+        CPPUNIT_ASSERT(values[0] != values[1]);
+
+        delete result;
+
+        DBG(cerr << "randomFunctionTest() - END." << endl);
+    }
+
+    void badTypeFunctionTest()
+    {
+        DBG(cerr << endl << "badTypeFunctionTest() - BEGIN." << endl);
+
+        debug_function::SynthArrayFunc synthArrayFunc;
+
+        libdap::btp_func synth_array_function = synthArrayFunc.get_btp_func();
+
+        libdap::Str type("type");
+        type.set_value("Grid");
+        libdap::Int32 dim1("dim1");
+        dim1.set_value(10);
+        libdap::BaseType *argv[] = { &type, &dim1 };
+        libdap::BaseType *result = 0;
+        libdap::BaseType **btpp = &result;
+
+        synth_array_function(2, argv, *testDDS, btpp);
+
+        if (debug) {
+            (*btpp)->print_val(cerr, "", false);
+            cerr << endl;
+        }
+
+        // Errors are reported in a String, not an Array
+        CPPUNIT_ASSERT(dynamic_cast<libdap::Str*>(result));
+
+        delete result;
+
+        DBG(cerr << "badTypeFunctionTest() - END." << endl);
+    }
+
+};
+
+CPPUNIT_TEST_SUITE_REGISTRATION(SynthArrayFunctionTest);
+
+} /* namespace libdap */
+
+int main(int argc, char*argv[])
+{
+    CppUnit::TextTestRunner runner;
+    runner.addTest(CppUnit::TestFactoryRegistry::getRegistry().makeTest());
+
+    GetOpt getopt(argc, argv, "d");
+    int option_char;
+    while ((option_char = getopt()) != -1)
+        switch (option_char) {
+        case 'd':
+            debug = true;  // debug is a static global
+            BESDebug::SetUp("cerr,DebugFunctions");
+            break;
+        default:
+            break;
+        }
+
+    bool wasSuccessful = true;
+    string test = "";
+    int i = getopt.optind;
+    if (i == argc) {
+        // run them all
+        wasSuccessful = runner.run("");
+    }
+    else {
+        while (i < argc) {
+            test = string("libdap::SynthArrayFunctionTest::") + argv[i++];
+
+            DBG(cerr << endl << "Running test " << test << endl << endl);
+
+            wasSuccessful = wasSuccessful && runner.run(test);
+        }
+    }
+
+    return wasSuccessful ? 0 : 1;
+}